@@ -0,0 +1,162 @@
+#define _GNU_SOURCE // For sched_setaffinity and the CPU_* macros
+#include "affinity.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+
+typedef struct {
+    int cpu;
+    int package;
+    int core;
+    int thread; // index among the allowed SMT siblings of its core
+} CpuInfo;
+
+static const char *const policy_names[] = { "inherit", "rr", "spread", "pack" };
+
+static AffinityPolicy policy = AFFINITY_INHERIT;
+static int *order = NULL;   // CPUs in the order children are placed on them
+static int order_count = 0;
+static int next_slot = 0;
+
+int affinity_parse_policy(const char *name, AffinityPolicy *out) {
+    for (int i = 0; i < (int)(sizeof(policy_names) / sizeof(policy_names[0])); i++) {
+        if (strcmp(name, policy_names[i]) == 0) {
+            *out = (AffinityPolicy)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Parses a kernel-style CPU list ("0-3,8,10-11") into set
+static int parse_cpulist(const char *list, cpu_set_t *set) {
+    CPU_ZERO(set);
+    const char *p = list;
+    do {
+        char *end;
+        errno = 0;
+        long first = strtol(p, &end, 10);
+        if (end == p || errno != 0) return -1;
+        long last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || errno != 0) return -1;
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE) return -1;
+        for (long cpu = first; cpu <= last; cpu++) CPU_SET(cpu, set);
+        p = end;
+    } while (*p++ == ',');
+    return p[-1] == '\0' ? 0 : -1;
+}
+
+// Reads one topology attribute of cpu; -1 if the kernel does not provide it
+static int read_topology(int cpu, const char *attr) {
+    char path[96];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, attr);
+    FILE *f = fopen(path, "re");
+    if (!f) return -1;
+    int value;
+    if (fscanf(f, "%d", &value) != 1) value = -1;
+    fclose(f);
+    return value;
+}
+
+static int compare_spread(const void *a, const void *b) {
+    const CpuInfo *x = a, *y = b;
+    if (x->thread != y->thread) return x->thread - y->thread;
+    if (x->core != y->core) return x->core - y->core;
+    if (x->package != y->package) return x->package - y->package;
+    return x->cpu - y->cpu;
+}
+
+static int compare_pack(const void *a, const void *b) {
+    const CpuInfo *x = a, *y = b;
+    if (x->package != y->package) return x->package - y->package;
+    if (x->core != y->core) return x->core - y->core;
+    return x->cpu - y->cpu;
+}
+
+// Fills the placement order for policy from the CPUs in set
+static int build_order(AffinityPolicy new_policy, const cpu_set_t *set) {
+    int count = CPU_COUNT(set);
+    CpuInfo *info = malloc(sizeof(CpuInfo) * (count ? count : 1));
+    int *new_order = malloc(sizeof(int) * (count ? count : 1));
+    if (!info || !new_order) {
+        free(info);
+        free(new_order);
+        errno = ENOMEM;
+        return -1;
+    }
+    int n = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE && n < count; cpu++) {
+        if (!CPU_ISSET(cpu, set)) continue;
+        CpuInfo *c = &info[n++];
+        c->cpu = cpu;
+        c->package = read_topology(cpu, "physical_package_id");
+        c->core = read_topology(cpu, "core_id");
+        if (c->core < 0) c->core = cpu; // no topology: every CPU is its own core
+        // CPUs are visited in numeric order, so earlier siblings are already counted
+        c->thread = 0;
+        for (int i = 0; i < n - 1; i++) {
+            if (info[i].package == c->package && info[i].core == c->core) c->thread++;
+        }
+    }
+    if (new_policy == AFFINITY_SPREAD) qsort(info, n, sizeof(CpuInfo), compare_spread);
+    else if (new_policy == AFFINITY_PACK) qsort(info, n, sizeof(CpuInfo), compare_pack);
+    for (int i = 0; i < n; i++) new_order[i] = info[i].cpu;
+    free(info);
+
+    free(order);
+    order = new_order;
+    order_count = n;
+    next_slot = 0;
+    return 0;
+}
+
+int affinity_configure(AffinityPolicy new_policy, const char *cpulist) {
+    cpu_set_t usable;
+    if (sched_getaffinity(0, sizeof(usable), &usable) != 0) return -1;
+    cpu_set_t set = usable;
+    if (cpulist) {
+        if (parse_cpulist(cpulist, &set) != 0) {
+            errno = EINVAL;
+            return -1;
+        }
+        cpu_set_t outside;
+        CPU_XOR(&outside, &set, &usable);
+        CPU_AND(&outside, &outside, &set);
+        if (CPU_COUNT(&set) == 0 || CPU_COUNT(&outside) > 0) {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    if (new_policy != AFFINITY_INHERIT && build_order(new_policy, &set) != 0) return -1;
+    policy = new_policy;
+    return 0;
+}
+
+int affinity_next_cpu(void) {
+    if (policy == AFFINITY_INHERIT || order_count == 0) return -1;
+    int cpu = order[next_slot];
+    next_slot = (next_slot + 1) % order_count;
+    return cpu;
+}
+
+int affinity_pin(pid_t pid, int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(pid, sizeof(set), &set);
+}
+
+void affinity_print(void) {
+    printf("affinity: %s", policy_names[policy]);
+    if (policy != AFFINITY_INHERIT) {
+        printf(" cpus");
+        for (int i = 0; i < order_count; i++) printf("%s%d", i ? "," : " ", order[i]);
+    }
+    printf("\n");
+}
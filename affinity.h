@@ -0,0 +1,34 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <sys/types.h>
+
+// CPU placement for spawned children. By default children inherit the shell's
+// affinity and the kernel places them; the other policies pin each new child
+// to one CPU of an allowed set, taken in turn from an order chosen by the
+// policy using the topology in /sys/devices/system/cpu.
+typedef enum {
+    AFFINITY_INHERIT,
+    AFFINITY_ROUND_ROBIN, // allowed CPUs in numeric order
+    AFFINITY_SPREAD,      // one SMT thread of every core first, then the siblings
+    AFFINITY_PACK         // both siblings of a core before the next core
+} AffinityPolicy;
+
+// Parses "inherit", "rr", "spread" or "pack". Returns 0, or -1 if unknown.
+int affinity_parse_policy(const char *name, AffinityPolicy *out);
+
+// Sets the policy over the CPUs in cpulist ("0-3,8"), or every CPU the shell
+// may run on when cpulist is NULL. Returns 0, or -1 with errno set (EINVAL for
+// a malformed list or CPUs the shell cannot use).
+int affinity_configure(AffinityPolicy policy, const char *cpulist);
+
+// CPU the next child should be pinned to, or -1 to inherit
+int affinity_next_cpu(void);
+
+// Pins pid (0 for the calling process) to cpu. Returns 0, or -1 with errno set.
+int affinity_pin(pid_t pid, int cpu);
+
+// Prints the policy and the CPU order for the `affinity` builtin
+void affinity_print(void);
+
+#endif // AFFINITY_H
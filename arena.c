@@ -0,0 +1,67 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+
+#define ARENA_MIN_CHUNK 4096
+
+static ArenaChunk *new_chunk(Arena *arena, size_t cap) {
+    ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + cap);
+    if (!chunk) return NULL;
+    chunk->cap = cap;
+    chunk->used = 0;
+    chunk->next = arena->head;
+    arena->head = chunk;
+    arena->total_cap += cap;
+    arena->malloc_calls++;
+    return chunk;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    const size_t align = alignof(max_align_t);
+    size = (size + align - 1) & ~(align - 1);
+    ArenaChunk *chunk = arena->head;
+    if (!chunk || chunk->cap - chunk->used < size) {
+        size_t cap = arena->total_cap > ARENA_MIN_CHUNK ? arena->total_cap : ARENA_MIN_CHUNK;
+        while (cap < size) cap *= 2;
+        chunk = new_chunk(arena, cap);
+        if (!chunk) return NULL;
+    }
+    void *p = chunk->data + chunk->used;
+    chunk->used += size;
+    return p;
+}
+
+char *arena_strndup(Arena *arena, const char *s, size_t len) {
+    char *copy = arena_alloc(arena, len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+// Keeps a single chunk. If the last line overflowed into several chunks, they are
+// replaced by one chunk big enough for all of them, so the next such line fits.
+void arena_reset(Arena *arena) {
+    arena->resets++;
+    ArenaChunk *chunk = arena->head;
+    if (!chunk) return;
+    if (chunk->next) {
+        size_t total = arena->total_cap;
+        arena_free(arena);
+        new_chunk(arena, total);
+        return;
+    }
+    chunk->used = 0;
+}
+
+void arena_free(Arena *arena) {
+    ArenaChunk *chunk = arena->head;
+    while (chunk) {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+    arena->total_cap = 0;
+}
@@ -0,0 +1,30 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdalign.h>
+
+// Bump allocator for per-line data. Allocations are never freed individually;
+// arena_reset() releases everything at once and keeps the memory for reuse, so
+// a line that fits in what earlier lines used does not call malloc at all.
+
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t cap;
+    size_t used;
+    alignas(max_align_t) char data[];
+} ArenaChunk;
+
+typedef struct {
+    ArenaChunk *head;          // chunk currently being filled
+    size_t total_cap;          // capacity over all chunks
+    unsigned long malloc_calls; // chunks ever allocated
+    unsigned long resets;
+} Arena;
+
+void *arena_alloc(Arena *arena, size_t size);
+char *arena_strndup(Arena *arena, const char *s, size_t len);
+void arena_reset(Arena *arena);
+void arena_free(Arena *arena);
+
+#endif // ARENA_H
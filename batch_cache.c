@@ -0,0 +1,513 @@
+#define _GNU_SOURCE // For asprintf
+#include "batch_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "wish.h"
+#include "utils.h"
+#include "command.h"
+#include "parse.h"
+#include "linescan.h"
+
+#define COMPILED_MAGIC 0x43485357u // "WSHC"
+#define COMPILED_VERSION 2
+#define COMPILED_SUFFIX ".wishc"
+// Cached compiled forms not refreshed for this long are removed
+#define CACHE_MAX_AGE_SEC (30 * 24 * 60 * 60)
+
+// The file starts with this header, followed by line_count LineRecords. All
+// offsets inside a record are from the record's start; records are 8-byte
+// aligned and zero padded, so every record ends in a NUL.
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint64_t source_hash;
+    uint64_t payload_hash; // of the records, continued from source_hash
+    uint64_t line_count;
+} CompiledHeader;
+
+// One non-empty line: cmd_count CompiledCommands, then the arg_total string
+// offsets of their argv vectors, then the strings and the line text
+typedef struct {
+    uint32_t size;        // of the whole record
+    uint32_t cmd_count;
+    uint32_t arg_total;
+    uint32_t text;        // the trimmed line, annotation included
+    uint32_t text_len;
+    uint32_t body_offset; // where the commands start in the text
+} LineRecord;
+
+typedef struct {
+    uint32_t arg_count;
+    uint32_t args;        // offset of arg_count string offsets
+    uint32_t redir;       // offset of the '>' target, 0 if none
+    uint8_t invalid;
+    uint8_t pipe_next;
+    uint8_t pad[2];
+} CompiledCommand;
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} Buffer;
+
+typedef enum {
+    CACHE_UNSET = -1,  // not yet read from WISH_BATCH_CACHE
+    CACHE_OFF,         // run the text only
+    CACHE_SIDECAR,     // use script.wishc when `wish --compile` wrote one
+    CACHE_AUTOMATIC,   // also compile every script into $XDG_CACHE_HOME/wish
+} CacheMode;
+
+static CacheMode mode = CACHE_UNSET;
+
+// Commands of the line being run, rebuilt from each record; they only grow
+static Command *line_cmds = NULL;
+static int line_cmd_cap = 0;
+static char **line_args = NULL;
+static size_t line_arg_cap = 0;
+
+bool batch_cache_enabled(void) {
+    if (mode == CACHE_UNSET) {
+        const char *env = getenv("WISH_BATCH_CACHE");
+        mode = !env ? CACHE_SIDECAR : strcmp(env, "off") == 0 ? CACHE_OFF
+             : strcmp(env, "on") == 0 ? CACHE_AUTOMATIC : CACHE_SIDECAR;
+    }
+    return mode != CACHE_OFF;
+}
+
+static size_t align8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+// FNV-1a over the records, started from the source's hash, so records that
+// were altered or copied from another script's compiled form do not match
+static uint64_t payload_hash(uint64_t source_hash, const char *records, size_t len) {
+    uint64_t h = source_hash;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)records[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/* ----------------- Compiling ----------------- */
+
+static int reserve(Buffer *b, size_t extra) {
+    if (b->len + extra <= b->cap) return 0;
+    size_t new_cap = b->cap ? b->cap * 2 : 64 * 1024;
+    while (new_cap < b->len + extra) new_cap *= 2;
+    char *p = realloc(b->data, new_cap);
+    if (!p) return -1;
+    b->data = p;
+    b->cap = new_cap;
+    return 0;
+}
+
+// Length of a leading "[label:deps]" annotation and the blanks after it, as
+// dag_begin_line will strip it. Malformed annotations are left to it to report.
+static size_t annotation_length(const char *line, size_t len) {
+    if (len < 2 || line[0] != '[' || line[1] == ' ' || line[1] == '\t') return 0;
+    const char *close = memchr(line, ']', len);
+    if (!close) return 0;
+    size_t n = (size_t)(close - line) + 1;
+    while (n < len && (line[n] == ' ' || line[n] == '\t')) n++;
+    return n;
+}
+
+// Appends one line's record. Returns 0, or -1 with errno set.
+static int append_record(Buffer *b, const char *text, size_t text_len, size_t body_offset,
+                         const Command *cmds, int cmd_count) {
+    size_t arg_total = 0;
+    size_t strings = text_len + 1;
+    for (int c = 0; c < cmd_count; c++) {
+        arg_total += cmds[c].arg_count;
+        for (int a = 0; a < cmds[c].arg_count; a++) strings += strlen(cmds[c].args[a]) + 1;
+        if (cmds[c].redir_target) strings += strlen(cmds[c].redir_target) + 1;
+    }
+    size_t fixed = sizeof(LineRecord) + sizeof(CompiledCommand) * cmd_count + sizeof(uint32_t) * arg_total;
+    size_t size = align8(fixed + strings);
+    if (size > UINT32_MAX) {
+        errno = EFBIG;
+        return -1;
+    }
+    if (reserve(b, size) != 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    char *rec = b->data + b->len;
+    memset(rec, 0, size);
+    LineRecord *r = (LineRecord *)rec;
+    r->size = (uint32_t)size;
+    r->cmd_count = (uint32_t)cmd_count;
+    r->arg_total = (uint32_t)arg_total;
+    r->text_len = (uint32_t)text_len;
+    r->body_offset = (uint32_t)body_offset;
+
+    CompiledCommand *cc = (CompiledCommand *)(rec + sizeof(LineRecord));
+    uint32_t *offsets = (uint32_t *)(cc + cmd_count);
+    char *p = (char *)(offsets + arg_total);
+    for (int c = 0; c < cmd_count; c++) {
+        cc[c].arg_count = (uint32_t)cmds[c].arg_count;
+        cc[c].args = (uint32_t)((char *)offsets - rec);
+        cc[c].invalid = cmds[c].invalid;
+        cc[c].pipe_next = cmds[c].pipe_next;
+        for (int a = 0; a < cmds[c].arg_count; a++) {
+            *offsets++ = (uint32_t)(p - rec);
+            p = stpcpy(p, cmds[c].args[a]) + 1;
+        }
+        if (cmds[c].redir_target) {
+            cc[c].redir = (uint32_t)(p - rec);
+            p = stpcpy(p, cmds[c].redir_target) + 1;
+        }
+    }
+    r->text = (uint32_t)(p - rec);
+    memcpy(p, text, text_len);
+    b->len += size;
+    return 0;
+}
+
+// Compiles the source text into b. Lines are split and trimmed exactly as
+// run_mapped_batch does. Returns 0, or -1 with errno set.
+static int compile_source(const char *data, size_t size, const struct stat *st, uint64_t hash, Buffer *b) {
+    CompiledHeader h = { COMPILED_MAGIC, COMPILED_VERSION, (uint64_t)size,
+                         (int64_t)st->st_mtim.tv_sec, (int64_t)st->st_mtim.tv_nsec, hash, 0, 0 };
+    if (reserve(b, sizeof(h)) != 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    b->len = sizeof(h);
+    MappedInput in = { data, size, data };
+    const char *view;
+    size_t view_len;
+    while ((view = mapped_input_next(&in, &view_len)) != NULL) {
+        view = trim_view(view, &view_len);
+        if (view_len == 0) continue;
+        size_t body_offset = annotation_length(view, view_len);
+        int cmd_count = 0;
+        Command *cmds = parse_line(view + body_offset, view_len - body_offset, &cmd_count);
+        int status = cmds ? append_record(b, view, view_len, body_offset, cmds, cmd_count) : -1;
+        parse_reset();
+        if (status != 0) {
+            if (!cmds) errno = ENOMEM;
+            return -1;
+        }
+        h.line_count++;
+    }
+    h.payload_hash = payload_hash(hash, b->data + sizeof(h), b->len - sizeof(h));
+    memcpy(b->data, &h, sizeof(h));
+    return 0;
+}
+
+/* ----------------- Running ----------------- */
+
+// Checks the header against the source, that the records exactly fill the
+// file and that they are the ones compiled from this source
+static bool compiled_matches(const char *data, size_t size, const struct stat *st, uint64_t hash) {
+    if (size < sizeof(CompiledHeader)) return false;
+    const CompiledHeader *h = (const CompiledHeader *)data;
+    if (h->magic != COMPILED_MAGIC || h->version != COMPILED_VERSION ||
+        h->source_size != (uint64_t)st->st_size || h->source_mtime_sec != (int64_t)st->st_mtim.tv_sec ||
+        h->source_mtime_nsec != (int64_t)st->st_mtim.tv_nsec || h->source_hash != hash) {
+        return false;
+    }
+    size_t off = sizeof(CompiledHeader);
+    for (uint64_t i = 0; i < h->line_count; i++) {
+        if (size - off < sizeof(LineRecord)) return false;
+        const LineRecord *r = (const LineRecord *)(data + off);
+        if (r->size < sizeof(LineRecord) || r->size % 8 != 0 || r->size > size - off) return false;
+        off += r->size;
+    }
+    return off == size &&
+           h->payload_hash == payload_hash(hash, data + sizeof(CompiledHeader), size - sizeof(CompiledHeader));
+}
+
+static int grow_line_vectors(uint32_t cmd_count, uint32_t arg_total) {
+    if ((int)cmd_count > line_cmd_cap) {
+        Command *p = realloc(line_cmds, sizeof(Command) * cmd_count);
+        if (!p) return -1;
+        line_cmds = p;
+        line_cmd_cap = (int)cmd_count;
+    }
+    size_t args_needed = (size_t)arg_total + cmd_count; // each argv ends in NULL
+    if (args_needed > line_arg_cap) {
+        char **p = realloc(line_args, sizeof(char*) * args_needed);
+        if (!p) return -1;
+        line_args = p;
+        line_arg_cap = args_needed;
+    }
+    return 0;
+}
+
+// Rebuilds a record's Commands as pointers into the record. Returns the
+// command count, or -1 if the record is inconsistent.
+static int load_record(char *rec) {
+    const LineRecord *r = (const LineRecord *)rec;
+    size_t size = r->size;
+    if (sizeof(LineRecord) + (uint64_t)sizeof(CompiledCommand) * r->cmd_count > size ||
+        r->text >= size || r->text_len >= size - r->text || r->body_offset > r->text_len ||
+        grow_line_vectors(r->cmd_count, r->arg_total) != 0) {
+        return -1;
+    }
+    const CompiledCommand *cc = (const CompiledCommand *)(rec + sizeof(LineRecord));
+    char **args = line_args;
+    size_t args_left = r->arg_total;
+    for (uint32_t c = 0; c < r->cmd_count; c++) {
+        uint32_t n = cc[c].arg_count;
+        if (n > args_left || cc[c].args > size || (uint64_t)n * sizeof(uint32_t) > size - cc[c].args ||
+            cc[c].redir >= size) {
+            return -1;
+        }
+        args_left -= n;
+        Command *cmd = &line_cmds[c];
+        const uint32_t *offsets = (const uint32_t *)(rec + cc[c].args);
+        for (uint32_t a = 0; a < n; a++) {
+            if (offsets[a] >= size) return -1;
+            args[a] = rec + offsets[a]; // the record's last byte is a NUL
+        }
+        args[n] = NULL;
+        cmd->args = args;
+        cmd->arg_count = (int)n;
+        cmd->name = n > 0 ? args[0] : NULL;
+        cmd->redir_target = cc[c].redir ? rec + cc[c].redir : NULL;
+        cmd->invalid = cc[c].invalid;
+        cmd->pipe_next = cc[c].pipe_next;
+        args += n + 1;
+    }
+    return (int)r->cmd_count;
+}
+
+// Runs every line of a compiled script that compiled_matches accepted
+static void run_compiled(char *data) {
+    const CompiledHeader *h = (const CompiledHeader *)data;
+    size_t off = sizeof(CompiledHeader);
+    for (uint64_t i = 0; i < h->line_count; i++) {
+        char *rec = data + off;
+        const LineRecord *r = (const LineRecord *)rec;
+        off += r->size;
+        int cmd_count = load_record(rec);
+        if (cmd_count < 0) {
+            shell_error(EIO); // damaged since it was checked; stop rather than guess
+            return;
+        }
+        process_parsed_view(rec + r->text, r->text_len, r->body_offset, line_cmds, cmd_count);
+    }
+}
+
+// Runs the compiled file at path if it is current for the source. Returns 0
+// if it ran, -1 if it is missing or stale. The file's commands run as they
+// are, so only a file this user owns and nobody else can write is trusted.
+static int run_compiled_file(const char *path, const struct stat *source_st, uint64_t hash) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (size_t)st.st_size < sizeof(CompiledHeader) ||
+        st.st_uid != geteuid() || (st.st_mode & (S_IWGRP | S_IWOTH))) {
+        close(fd);
+        return -1;
+    }
+    // Private and writable, so the Commands' strings behave like the parser's
+    size_t size = (size_t)st.st_size;
+    char *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return -1;
+    int status = -1;
+    if (compiled_matches(data, size, source_st, hash)) {
+        run_compiled(data);
+        status = 0;
+    }
+    munmap(data, size);
+    return status;
+}
+
+/* ----------------- Files ----------------- */
+
+// $XDG_CACHE_HOME/wish/<hash of the script's real path>.wishc, or NULL if
+// there is no cache directory to use
+static char *cache_path(const char *script) {
+    const char *base = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    char *real = realpath(script, NULL);
+    if (!real) return NULL;
+    unsigned long long h = (unsigned long long)hash_string(real);
+    free(real);
+    char *path = NULL;
+    int n = -1;
+    if (base && base[0] == '/') {
+        n = asprintf(&path, "%s/wish/%016llx" COMPILED_SUFFIX, base, h);
+    } else if (home && home[0] == '/') {
+        n = asprintf(&path, "%s/.cache/wish/%016llx" COMPILED_SUFFIX, home, h);
+    }
+    return n < 0 ? NULL : path;
+}
+
+// Creates the cache file's directory and its parent (e.g. ~/.cache/wish) and
+// checks that the directory is this user's own with mode 0700, so nobody else
+// can plant compiled scripts in it. Returns 0 if it can be used.
+static int make_cache_dirs(const char *path) {
+    char *dir = strdup(path);
+    if (!dir) return -1;
+    *strrchr(dir, '/') = '\0';
+    char *parent_end = strrchr(dir, '/');
+    int status = 0;
+    if (parent_end && parent_end != dir) {
+        *parent_end = '\0';
+        if (mkdir(dir, 0700) != 0 && errno != EEXIST) status = -1;
+        *parent_end = '/';
+    }
+    if (status == 0 && mkdir(dir, 0700) != 0 && errno != EEXIST) status = -1;
+    struct stat st;
+    if (status == 0 && (lstat(dir, &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != geteuid() ||
+                        ((st.st_mode & 077) && chmod(dir, 0700) != 0))) {
+        status = -1;
+    }
+    free(dir);
+    return status;
+}
+
+// Removes compiled forms in the cache directory of path that have not been
+// stored for CACHE_MAX_AGE_SEC, e.g. those of deleted temporary scripts
+static void prune_cache(const char *path) {
+    char *dir = strdup(path);
+    if (!dir) return;
+    *strrchr(dir, '/') = '\0';
+    DIR *d = opendir(dir);
+    free(dir);
+    if (!d) return;
+    time_t cutoff = time(NULL) - CACHE_MAX_AGE_SEC;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        size_t suffix = sizeof(COMPILED_SUFFIX) - 1;
+        if (len <= suffix || strcmp(entry->d_name + len - suffix, COMPILED_SUFFIX) != 0) continue;
+        struct stat st;
+        if (fstatat(dirfd(d), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && st.st_mtime < cutoff) {
+            unlinkat(dirfd(d), entry->d_name, 0);
+        }
+    }
+    closedir(d);
+}
+
+// Writes data to path through a temporary file and rename, so that a
+// concurrent run sees either the old file or the whole new one
+static int store_file(const char *path, const char *data, size_t len) {
+    char *tmp = NULL;
+    if (asprintf(&tmp, "%s.XXXXXX", path) < 0) return -1;
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        free(tmp);
+        return -1;
+    }
+    fchmod(fd, 0644); // mkstemp's 0600 would hide a sidecar from the script's other readers
+    size_t done = 0;
+    while (done < len) {
+        ssize_t w = write(fd, data + done, len - done);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0) break;
+        done += (size_t)w;
+    }
+    int status = -1;
+    if (close(fd) == 0 && done == len && rename(tmp, path) == 0) status = 0;
+    int saved = errno;
+    if (status != 0) unlink(tmp);
+    free(tmp);
+    errno = saved;
+    return status;
+}
+
+// Maps the source and hashes it. Returns 0, or -1 with errno set.
+static int map_source(int fd, struct stat *st, char **data, uint64_t *hash) {
+    if (fstat(fd, st) != 0) return -1;
+    if (!S_ISREG(st->st_mode)) {
+        errno = EINVAL;
+        return -1;
+    }
+    *data = NULL;
+    if (st->st_size > 0) {
+        void *p = mmap(NULL, (size_t)st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) return -1;
+        *data = p;
+    }
+    *hash = hash_bytes(*data, (size_t)st->st_size);
+    return 0;
+}
+
+/* ----------------- Public interface ----------------- */
+
+int batch_cache_run(const char *path, int fd) {
+    char *sidecar = NULL;
+    if (asprintf(&sidecar, "%s" COMPILED_SUFFIX, path) < 0) sidecar = NULL;
+    // Without the automatic cache most scripts have nothing to look for
+    if (mode != CACHE_AUTOMATIC && (!sidecar || access(sidecar, F_OK) != 0)) {
+        free(sidecar);
+        return -1;
+    }
+    struct stat st;
+    char *source;
+    uint64_t hash;
+    if (map_source(fd, &st, &source, &hash) != 0) {
+        free(sidecar);
+        return -1;
+    }
+
+    char *cached = mode == CACHE_AUTOMATIC ? cache_path(path) : NULL;
+    if (cached && make_cache_dirs(cached) != 0) {
+        free(cached);
+        cached = NULL;
+    }
+    int status = -1;
+    if ((sidecar && run_compiled_file(sidecar, &st, hash) == 0) ||
+        (cached && run_compiled_file(cached, &st, hash) == 0)) {
+        status = 0;
+    } else if (cached) {
+        Buffer b = { NULL, 0, 0 };
+        if (compile_source(source, (size_t)st.st_size, &st, hash, &b) == 0) {
+            // A failure only costs the next run a compile
+            if (store_file(cached, b.data, b.len) == 0) prune_cache(cached);
+            run_compiled(b.data);
+            status = 0;
+        }
+        free(b.data);
+    }
+    free(sidecar);
+    free(cached);
+    if (source) munmap(source, (size_t)st.st_size);
+    return status;
+}
+
+int batch_compile(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    char *source;
+    uint64_t hash;
+    int status = map_source(fd, &st, &source, &hash);
+    close(fd);
+    if (status != 0) return -1;
+
+    Buffer b = { NULL, 0, 0 };
+    char *out = NULL;
+    status = compile_source(source, (size_t)st.st_size, &st, hash, &b);
+    if (status == 0 && asprintf(&out, "%s" COMPILED_SUFFIX, path) < 0) {
+        errno = ENOMEM;
+        status = -1;
+    }
+    if (status == 0) status = store_file(out, b.data, b.len);
+    int saved = errno;
+    free(out);
+    free(b.data);
+    if (source) munmap(source, (size_t)st.st_size);
+    errno = saved;
+    return status;
+}
@@ -0,0 +1,32 @@
+#ifndef BATCH_CACHE_H
+#define BATCH_CACHE_H
+
+#include <stdbool.h>
+
+// Precompiled batch scripts. A script is compiled into a binary file holding
+// each line's parsed commands (argv vectors, redirect targets, '&' groups and
+// pipes) as NUL-terminated strings and offsets. Later runs map that file and
+// hand each line's commands to process_parsed_view, so no line is parsed again.
+// A compiled file records the source's size, mtime and hash, plus a hash of
+// its records chained from the source's, and is only used while all of them
+// still match. Only compiled files the user owns and that are not group- or
+// world-writable are run.
+//
+// A script runs from script.wishc when `wish --compile script` wrote one.
+// WISH_BATCH_CACHE=on also compiles every script run into $XDG_CACHE_HOME/wish
+// (by default ~/.cache/wish, kept at mode 0700), where compiled forms not
+// stored again for 30 days are removed. WISH_BATCH_CACHE=off runs scripts
+// from their text only.
+
+bool batch_cache_enabled(void);
+
+// Runs the batch file at path (open as fd) from its compiled form, compiling
+// and caching it first with WISH_BATCH_CACHE=on. Returns 0 once the script
+// has run, or -1 if there is no usable compiled form, in which case the
+// caller should run the text.
+int batch_cache_run(const char *path, int fd);
+
+// Writes path's compiled form to path.wishc. Returns 0, or -1 with errno set.
+int batch_compile(const char *path);
+
+#endif // BATCH_CACHE_H
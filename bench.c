@@ -0,0 +1,776 @@
+#define _GNU_SOURCE // For fmemopen and getline
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "wish.h"
+#include "command.h"
+#include "parse.h"
+#include "path_cache.h"
+#include "spawn.h"
+#include "program_array.h"
+#include "linescan.h"
+#include "reaper.h"
+#include "zygote.h"
+#include "complete.h"
+#include "history.h"
+#include "wildcard.h"
+#include "server.h"
+
+// Benchmark driver for `make bench`. Every result is one JSON object in the
+// "results" array, so runs can be diffed across versions. BENCH_SCALE (default
+// 1) multiplies the iteration counts.
+
+#define PARALLEL_LINE "ls -la /tmp & echo one two & cat file.txt > out.txt & wc -l a b c & true & date & pwd & uname -a"
+#define REDIR_LINE    "ls -la /tmp/some/dir --color=never > out.txt"
+
+static int scale = 1;
+static int first_result = 1;
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void report(const char *name, const char *unit, double value, long iterations) {
+    printf("%s\n    {\"name\": \"%s\", \"unit\": \"%s\", \"value\": %.3f, \"iterations\": %ld}",
+           first_result ? "" : ",", name, unit, value, iterations);
+    first_result = 0;
+    fflush(stdout);
+}
+
+static void report_ns_per_op(const char *name, long long start, long iterations) {
+    report(name, "ns/op", (double)(now_ns() - start) / iterations, iterations);
+}
+
+/* ----------------- Tokenization ----------------- */
+
+static void bench_tokenize(void) {
+    long n = 200000L * scale;
+    char buf[sizeof(REDIR_LINE)];
+    char *tokens[64];
+
+    long long start = now_ns();
+    for (long i = 0; i < n; i++) {
+        memcpy(buf, REDIR_LINE, sizeof(REDIR_LINE));
+        tokenize_input(buf, tokens, 64);
+    }
+    report_ns_per_op("tokenize_input", start, n);
+
+    char pbuf[sizeof(PARALLEL_LINE)];
+    start = now_ns();
+    for (long i = 0; i < n; i++) {
+        memcpy(pbuf, PARALLEL_LINE, sizeof(PARALLEL_LINE));
+        int count;
+        char **parts = split_parallel_commands(pbuf, &count);
+        free(parts);
+    }
+    report_ns_per_op("split_parallel_commands", start, n);
+
+    start = now_ns();
+    for (long i = 0; i < n; i++) {
+        memcpy(buf, REDIR_LINE, sizeof(REDIR_LINE));
+        char *target = NULL;
+        parse_redirection(buf, &target);
+        free(target);
+    }
+    report_ns_per_op("parse_redirection", start, n);
+
+    // The single-pass parser does all three jobs for the whole line
+    start = now_ns();
+    for (long i = 0; i < n; i++) {
+        int count;
+        parse_line(PARALLEL_LINE, sizeof(PARALLEL_LINE) - 1, &count);
+        parse_reset();
+    }
+    report_ns_per_op("parse_line_parallel", start, n);
+}
+
+/* ----------------- Batch line splitting ----------------- */
+
+static void bench_line_scan(void) {
+    long lines = 500000L * scale;
+    size_t line_len = sizeof(PARALLEL_LINE); // including the '\n'
+    size_t size = line_len * lines;
+    char *text = malloc(size);
+    if (!text) return;
+    for (long i = 0; i < lines; i++) {
+        memcpy(text + i * line_len, PARALLEL_LINE, line_len - 1);
+        text[i * line_len + line_len - 1] = '\n';
+    }
+
+    FILE *f = fmemopen(text, size, "r");
+    char *line = NULL;
+    size_t cap = 0;
+    long seen = 0;
+    long long start = now_ns();
+    while (f && getline(&line, &cap, f) != -1) {
+        char *copy = strdup(line); // what the old batch loop did per line
+        free(copy);
+        seen++;
+    }
+    double secs = (now_ns() - start) / 1e9;
+    report("batch_lines_getline", "lines/s", seen / secs, seen);
+    if (f) fclose(f);
+    free(line);
+
+    const char *p = text, *end = text + size;
+    seen = 0;
+    start = now_ns();
+    while (p < end) {
+        const char *nl = scan_line(p, end);
+        p = nl + 1;
+        seen++;
+    }
+    secs = (now_ns() - start) / 1e9;
+    report("batch_lines_scan_line", "lines/s", seen / secs, seen);
+    free(text);
+}
+
+/* ----------------- Executable resolution ----------------- */
+
+static void set_paths(int count) {
+    for (int i = 0; i < shell_path_count; i++) free(shell_paths[i]);
+    free(shell_paths);
+    shell_paths = malloc(sizeof(char*) * count);
+    shell_path_count = count;
+    char dir[64];
+    for (int i = 0; i < count - 1; i++) {
+        snprintf(dir, sizeof(dir), "/nonexistent/bench/dir%d", i);
+        shell_paths[i] = strdup(dir);
+    }
+    shell_paths[count - 1] = strdup("/bin");
+    path_cache_flush();
+}
+
+static void bench_resolve(void) {
+    const int path_len = 32;
+    long n = 20000L * scale;
+    char full[1024];
+    set_paths(path_len);
+
+    long long start = now_ns();
+    for (long i = 0; i < n; i++) {
+        path_cache_flush();
+        resolve_executable("ls", full, sizeof(full));
+    }
+    report_ns_per_op("resolve_32_paths_uncached", start, n);
+
+    n *= 50;
+    start = now_ns();
+    for (long i = 0; i < n; i++) {
+        resolve_executable("ls", full, sizeof(full));
+    }
+    report_ns_per_op("resolve_32_paths_cached", start, n);
+    set_paths(1);
+}
+
+/* ----------------- Completion ----------------- */
+
+static void bench_completion(void) {
+    const int entries = 20000;
+    char dir[] = "/tmp/wish-bench-XXXXXX";
+    if (!mkdtemp(dir)) return;
+    char file[64];
+    for (int i = 0; i < entries; i++) {
+        snprintf(file, sizeof(file), "%s/cmd%05d", dir, i);
+        int fd = open(file, O_CREAT | O_WRONLY, 0755);
+        if (fd >= 0) close(fd);
+    }
+    char *saved = shell_paths[0];
+    shell_paths[0] = dir;
+
+    // The first completion scans the directory; later ones binary-search its index
+    Completions c;
+    long long start = now_ns();
+    complete_line("cmd1234", 7, &c);
+    completions_free(&c);
+    report_ns_per_op("complete_command_20k_entries_cold", start, 1);
+
+    long n = 100000L * scale;
+    start = now_ns();
+    for (long i = 0; i < n; i++) {
+        complete_line("cmd1234", 7, &c);
+        completions_free(&c);
+    }
+    report_ns_per_op("complete_command_20k_entries", start, n);
+
+    shell_paths[0] = saved;
+    for (int i = 0; i < entries; i++) {
+        snprintf(file, sizeof(file), "%s/cmd%05d", dir, i);
+        unlink(file);
+    }
+    rmdir(dir);
+}
+
+/* ----------------- History ----------------- */
+
+static void bench_history(void) {
+    const int entries = 200000;
+    char path[] = "/tmp/wish-bench-hist-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return;
+    close(fd);
+    if (history_open(path) != 0) {
+        unlink(path);
+        return;
+    }
+    char line[128];
+    for (int i = 0; i < entries; i++) {
+        int len = snprintf(line, sizeof(line), "./build.sh --target t%d --jobs %d > out/log%d", i, i % 64, i);
+        history_add(line, (size_t)len);
+    }
+
+    // A fresh shell maps the log and walks it on first use
+    long long start = now_ns();
+    history_open(path);
+    history_count();
+    report_ns_per_op("history_open_200k_entries", start, 1);
+
+    // The first search also builds the trigram index
+    start = now_ns();
+    history_search("t123 ", 5, history_count());
+    report_ns_per_op("history_search_200k_first", start, 1);
+
+    // Each Ctrl-R keystroke is one search from the newest entry
+    const char *needles[] = { "t19999", "log777", "--jobs 7 ", "t5 " };
+    long n = 20000L * scale;
+    start = now_ns();
+    for (long i = 0; i < n; i++) {
+        const char *needle = needles[i % 4];
+        history_search(needle, strlen(needle), history_count());
+    }
+    report_ns_per_op("history_search_200k", start, n);
+
+    history_close();
+    unlink(path);
+}
+
+/* ----------------- Filename expansion ----------------- */
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// What a shell built on readdir and fnmatch does for one pattern
+static long glob_with_fnmatch(const char *dir, const char *pattern) {
+    DIR *d = opendir(dir);
+    if (!d) return 0;
+    size_t count = 0, cap = 1024;
+    char **names = malloc(sizeof(char*) * cap);
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] == '.' || fnmatch(pattern, entry->d_name, FNM_PERIOD) != 0) continue;
+        if (count == cap) names = realloc(names, sizeof(char*) * (cap *= 2));
+        size_t len = strlen(dir) + strlen(entry->d_name) + 2;
+        names[count] = malloc(len);
+        snprintf(names[count++], len, "%s/%s", dir, entry->d_name);
+    }
+    closedir(d);
+    qsort(names, count, sizeof(char*), compare_names);
+    for (size_t i = 0; i < count; i++) free(names[i]);
+    free(names);
+    return (long)count;
+}
+
+// Expands words as the arguments of one echo command; returns the word count
+static long glob_line(char **words, int word_count) {
+    char *args[8] = { "echo" };
+    memcpy(args + 1, words, sizeof(char*) * word_count);
+    args[word_count + 1] = NULL;
+    Command cmd = { .name = "echo", .args = args, .arg_count = word_count + 1 };
+    if (wildcard_expand(&cmd, 1) < 0) return 0;
+    return cmd.arg_count - 1;
+}
+
+static void bench_glob(void) {
+    const long files = 1000000;
+    char dir[] = "/tmp/wish-bench-XXXXXX";
+    if (!mkdtemp(dir)) return;
+    int dir_fd = open(dir, O_RDONLY | O_DIRECTORY);
+    char name[32];
+    long created = 0;
+    for (; created < files; created++) {
+        snprintf(name, sizeof(name), "f%07ld.%s", created, created % 2 ? "log" : "txt");
+        int fd = openat(dir_fd, name, O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd < 0) break; // out of inodes; measure what there is
+        close(fd);
+    }
+
+    char one[64], other[64];
+    snprintf(one, sizeof(one), "%s/*7.log", dir);
+    snprintf(other, sizeof(other), "%s/f00[0-4]*", dir);
+    char *single[] = { one };
+    char *both[] = { one, other };
+    long runs = 3L * scale;
+
+    // Every line reads the directory again; two patterns in one line share it
+    long long start = now_ns();
+    long matches = 0;
+    for (long i = 0; i < runs; i++) matches = glob_line(single, 1);
+    report_ns_per_op("glob_1m_files_one_pattern", start, runs);
+    start = now_ns();
+    for (long i = 0; i < runs; i++) glob_line(both, 2);
+    report_ns_per_op("glob_1m_files_two_patterns", start, runs);
+    start = now_ns();
+    for (long i = 0; i < runs; i++) glob_with_fnmatch(dir, "*7.log");
+    report_ns_per_op("glob_1m_files_readdir_fnmatch", start, runs);
+    report("glob_1m_files_matches", "paths", (double)matches, created);
+
+    glob_line((char *[]){ "" }, 0); // releases the expansion's memory
+    for (long i = 0; i < created; i++) {
+        snprintf(name, sizeof(name), "f%07ld.%s", i, i % 2 ? "log" : "txt");
+        unlinkat(dir_fd, name, 0);
+    }
+    close(dir_fd);
+    rmdir(dir);
+}
+
+/* ----------------- Launching ----------------- */
+
+static void bench_launch_mode(const char *name, SpawnMode mode, long n) {
+    char *argv[] = { "true", NULL };
+    spawn_set_mode(mode);
+    long long start = now_ns();
+    for (long i = 0; i < n; i++) {
+        pid_t pid = spawn_command("/bin/true", argv, NULL);
+        if (pid > 0) waitpid(pid, NULL, 0);
+    }
+    report_ns_per_op(name, start, n);
+}
+
+// Launches through the zygote and waits for its exit report, as the scheduler does
+static void bench_launch_zygote(const char *name, long n) {
+    if (!zygote_active()) return;
+    char *argv[] = { "true", NULL };
+    long long start = now_ns();
+    for (long i = 0; i < n; i++) {
+        pid_t pid = zygote_spawn("/bin/true", argv, NULL, -1, -1, -1);
+        if (pid < 0 || reaper_watch(pid) != 0) return;
+        ReapedChild child;
+        reaper_wait(&child, -1);
+    }
+    report_ns_per_op(name, start, n);
+}
+
+static void bench_launch(void) {
+    long n = 500L * scale;
+    bench_launch_mode("launch_true_posix_spawn", SPAWN_POSIX, n);
+    bench_launch_mode("launch_true_fork", SPAWN_FORK, n);
+    bench_launch_zygote("launch_true_zygote", n);
+
+    // A larger parent makes fork copy more page tables; posix_spawn should not care
+    size_t big = 256UL << 20;
+    char *ballast = malloc(big);
+    if (ballast) {
+        memset(ballast, 1, big);
+        bench_launch_mode("launch_true_posix_spawn_256mb_parent", SPAWN_POSIX, n);
+        bench_launch_mode("launch_true_fork_256mb_parent", SPAWN_FORK, n);
+        bench_launch_zygote("launch_true_zygote_256mb_parent", n);
+        free(ballast);
+    }
+    spawn_set_mode(SPAWN_POSIX);
+}
+
+/* ----------------- Startup ----------------- */
+
+static void bench_startup(void) {
+    long n = 20L * scale;
+    long long start = now_ns();
+    for (long i = 0; i < n; i++) {
+        free_program_array(get_all_programs());
+    }
+    report_ns_per_op("get_all_programs", start, n);
+
+    // Whole-process cold start of the shell on an empty batch file
+    char *argv[] = { "wish", "/dev/null", NULL };
+    n = 200L * scale;
+    start = now_ns();
+    for (long i = 0; i < n; i++) {
+        pid_t pid = spawn_command("./wish", argv, NULL);
+        if (pid < 0) return;
+        waitpid(pid, NULL, 0);
+    }
+    report_ns_per_op("wish_startup", start, n);
+}
+
+/* ----------------- End-to-end batch throughput ----------------- */
+
+static void bench_batch_width(int width) {
+    long commands = 2000L * scale;
+    char path[] = "/tmp/wish-bench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return;
+    FILE *f = fdopen(fd, "w");
+    for (long i = 0; i < commands; i += width) {
+        for (int w = 0; w < width; w++) {
+            fputs(w ? " & /bin/true" : "/bin/true", f);
+        }
+        fputc('\n', f);
+    }
+    fclose(f);
+
+    char *argv[] = { "wish", path, NULL };
+    long long start = now_ns();
+    pid_t pid = spawn_command("./wish", argv, NULL);
+    if (pid > 0) waitpid(pid, NULL, 0);
+    double secs = (now_ns() - start) / 1e9;
+    unlink(path);
+
+    char name[64];
+    snprintf(name, sizeof(name), "batch_throughput_width_%d", width);
+    report(name, "commands/s", commands / secs, commands);
+}
+
+static void bench_batch(void) {
+    int widths[] = { 1, 4, 16, 64 };
+    for (size_t i = 0; i < sizeof(widths) / sizeof(widths[0]); i++) {
+        bench_batch_width(widths[i]);
+    }
+}
+
+/* ----------------- Wide lines ----------------- */
+
+// Runs one generated line through the shell. Returns the seconds it took, or
+// -1 if the shell did not exit cleanly.
+static double run_shell_line(const char *path) {
+    char *argv[] = { "wish", (char *)path, NULL };
+    long long start = now_ns();
+    pid_t pid = spawn_command("./wish", argv, NULL);
+    int status = -1;
+    if (pid > 0) waitpid(pid, &status, 0);
+    double secs = (now_ns() - start) / 1e9;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? secs : -1;
+}
+
+// A 10,000-way '&' line and a 100k-argument command. Each reports the time
+// taken, and the argument case also how many words reached the program
+// (the full count means nothing was truncated).
+static void bench_wide_lines(void) {
+    const int width = 10000;
+    const int arg_count = 100000;
+    char path[] = "/tmp/wish-bench-XXXXXX";
+    char out_path[] = "/tmp/wish-bench-out-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return;
+    int out_fd = mkstemp(out_path);
+    if (out_fd < 0) {
+        close(fd);
+        unlink(path);
+        return;
+    }
+    close(out_fd);
+
+    FILE *f = fdopen(fd, "w");
+    for (int w = 0; w < width; w++) fputs(w ? " & /bin/true" : "/bin/true", f);
+    fputc('\n', f);
+    fclose(f);
+    report("wide_line_10000_commands", "s", run_shell_line(path), width);
+
+    f = fopen(path, "w");
+    if (!f) goto done;
+    fputs("/bin/echo", f);
+    for (int i = 0; i < arg_count; i++) fprintf(f, " a%d", i);
+    fprintf(f, " > %s\n", out_path);
+    fclose(f);
+    report("wide_line_100k_args", "s", run_shell_line(path), arg_count);
+
+    // Count the words echo printed
+    long words = 0;
+    f = fopen(out_path, "r");
+    if (f) {
+        int c, prev = ' ';
+        while ((c = fgetc(f)) != EOF) {
+            if (c != ' ' && c != '\n' && (prev == ' ' || prev == '\n')) words++;
+            prev = c;
+        }
+        fclose(f);
+    }
+    report("wide_line_100k_args_received", "args", words, arg_count);
+done:
+    unlink(path);
+    unlink(out_path);
+}
+
+/* ----------------- Compiled scripts ----------------- */
+
+// Seconds for one run of the script at path with the given WISH_BATCH_CACHE
+static double time_batch_run(const char *path, const char *cache_mode) {
+    setenv("WISH_BATCH_CACHE", cache_mode, 1);
+    char *argv[] = { "wish", (char *)path, NULL };
+    long long start = now_ns();
+    pid_t pid = spawn_command("./wish", argv, NULL);
+    if (pid > 0) waitpid(pid, NULL, 0);
+    double secs = (now_ns() - start) / 1e9;
+    unsetenv("WISH_BATCH_CACHE");
+    return secs;
+}
+
+// Distinct lines of in-process `true`, so the run is dominated by reading and
+// parsing rather than launching, and the plan cache cannot help
+static void bench_compiled_batch(void) {
+    long lines = 50000L * scale;
+    char dir[] = "/tmp/wish-bench-XXXXXX";
+    if (!mkdtemp(dir)) return;
+    char path[64], cache_dir[64];
+    snprintf(path, sizeof(path), "%s/script", dir);
+    snprintf(cache_dir, sizeof(cache_dir), "%s/wish", dir);
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        rmdir(dir);
+        return;
+    }
+    for (long i = 0; i < lines; i++) {
+        fprintf(f, "true --id %ld alpha beta & true gamma%ld > /dev/null & true x y z\n", i, i % 97);
+    }
+    fclose(f);
+    setenv("XDG_CACHE_HOME", dir, 1); // the compiled form goes to dir/wish
+    setenv("WISH_INPROC", "on", 1);
+
+    report("batch_compile_and_run_lines_per_s", "lines/s", lines / time_batch_run(path, "on"), lines);
+    report("batch_compiled_lines_per_s", "lines/s", lines / time_batch_run(path, "on"), lines);
+    report("batch_text_lines_per_s", "lines/s", lines / time_batch_run(path, "off"), lines);
+
+    unsetenv("WISH_INPROC");
+    unsetenv("XDG_CACHE_HOME");
+    DIR *cache = opendir(cache_dir);
+    if (cache) {
+        struct dirent *entry;
+        while ((entry = readdir(cache)) != NULL) unlinkat(dirfd(cache), entry->d_name, 0);
+        closedir(cache);
+        rmdir(cache_dir);
+    }
+    unlink(path);
+    rmdir(dir);
+}
+
+/* ----------------- Trivial utilities: in-process vs exec ----------------- */
+
+static void bench_trivial_batch(const char *inproc_mode) {
+    static const char *lines[] = {
+        "true", "echo hello world > /dev/null", "printf %s-%d\\n a 1 > /dev/null", "sleep 0",
+    };
+    long commands = 2000L * scale;
+    char path[] = "/tmp/wish-bench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return;
+    FILE *f = fdopen(fd, "w");
+    for (long i = 0; i < commands; i++) {
+        fprintf(f, "%s\n", lines[i % 4]);
+    }
+    fclose(f);
+
+    setenv("WISH_INPROC", inproc_mode, 1);
+    char *argv[] = { "wish", path, NULL };
+    long long start = now_ns();
+    pid_t pid = spawn_command("./wish", argv, NULL);
+    if (pid > 0) waitpid(pid, NULL, 0);
+    double secs = (now_ns() - start) / 1e9;
+    unsetenv("WISH_INPROC");
+    unlink(path);
+
+    char name[64];
+    snprintf(name, sizeof(name), "trivial_batch_inproc_%s", inproc_mode);
+    report(name, "commands/s", commands / secs, commands);
+}
+
+static void bench_trivial(void) {
+    bench_trivial_batch("off");
+    bench_trivial_batch("on");
+}
+
+/* ----------------- Command server under load ----------------- */
+
+static int compare_ns(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+// clients processes each send requests copies of line to the server at path,
+// one at a time (at most 64 clients); reports requests/s over all of them and the p99 latency
+static void bench_serve_load(const char *path, const char *name, const char *line, int clients, long requests) {
+    long total = clients * requests;
+    long long *latencies = mmap(NULL, sizeof(long long) * total, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (latencies == MAP_FAILED) return;
+    pid_t pids[64];
+    long long start = now_ns();
+    for (int c = 0; c < clients; c++) {
+        if ((pids[c] = fork()) != 0) continue;
+        int null_fd = open("/dev/null", O_WRONLY);
+        int fd = serve_connect(path);
+        for (long i = 0; fd >= 0 && i < requests; i++) {
+            long long sent = now_ns();
+            int out = i == 0 ? null_fd : -1; // the connection keeps the descriptors
+            if (serve_request(fd, line, strlen(line), out, out) != 0) break;
+            latencies[c * requests + i] = now_ns() - sent;
+        }
+        _exit(0);
+    }
+    for (int c = 0; c < clients; c++) {
+        if (pids[c] > 0) waitpid(pids[c], NULL, 0);
+    }
+    double secs = (now_ns() - start) / 1e9;
+
+    char result[96];
+    snprintf(result, sizeof(result), "serve_%s_%dc_requests_per_s", name, clients);
+    report(result, "requests/s", total / secs, total);
+    qsort(latencies, total, sizeof(long long), compare_ns);
+    snprintf(result, sizeof(result), "serve_%s_%dc_p99", name, clients);
+    report(result, "ns", (double)latencies[total * 99 / 100], total);
+    munmap(latencies, sizeof(long long) * total);
+}
+
+static void bench_serve(void) {
+    char dir[] = "/tmp/wish-bench-XXXXXX";
+    if (!mkdtemp(dir)) return;
+    char path[64];
+    snprintf(path, sizeof(path), "%s/sock", dir);
+    char *argv[] = { "wish", "--serve", path, NULL };
+    pid_t server = spawn_command("./wish", argv, NULL);
+    if (server < 0) {
+        rmdir(dir);
+        return;
+    }
+    int probe = -1;
+    for (int tries = 0; tries < 500 && (probe = serve_connect(path)) < 0; tries++) usleep(2000);
+    if (probe >= 0) {
+        close(probe);
+        long requests = 2000L * scale;
+        // In-shell commands measure the server itself; uname is a real launch
+        bench_serve_load(path, "true", "true", 1, requests);
+        bench_serve_load(path, "true", "true", 8, requests / 8);
+        bench_serve_load(path, "uname", "uname", 1, requests / 4);
+        bench_serve_load(path, "uname", "uname", 8, requests / 16);
+    }
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+
+    // The same request as a fresh shell per call, which is what the server replaces
+    char script[64];
+    snprintf(script, sizeof(script), "%s/script", dir);
+    FILE *f = fopen(script, "w");
+    if (f) {
+        fputs("uname > /dev/null\n", f);
+        fclose(f);
+        char *fresh[] = { "wish", script, NULL };
+        long n = 200L * scale;
+        long long start = now_ns();
+        for (long i = 0; i < n; i++) {
+            pid_t pid = spawn_command("./wish", fresh, NULL);
+            if (pid < 0) break;
+            waitpid(pid, NULL, 0);
+        }
+        report_ns_per_op("serve_baseline_fresh_shell_uname", start, n);
+        unlink(script);
+    }
+    rmdir(dir);
+}
+
+/* ----------------- Event core: io_uring vs epoll ----------------- */
+
+// Runs the shell on input (a stream, so it reads with getline or the ring)
+// under ptrace and counts the system calls it makes itself; its children are
+// not traced. Returns the count, or -1.
+static long count_shell_syscalls(const char *input, const char *uring_mode) {
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        int in = open(input, O_RDONLY);
+        int out = open("/dev/null", O_WRONLY);
+        if (in < 0 || out < 0) _exit(127);
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        dup2(out, STDERR_FILENO);
+        setenv("WISH_URING", uring_mode, 1);
+        ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+        execl("./wish", "wish", (char *)NULL);
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status)) return -1; // stopped at exec
+    ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *)PTRACE_O_TRACESYSGOOD);
+    long stops = 0;
+    int sig = 0;
+    while (ptrace(PTRACE_SYSCALL, pid, NULL, (void *)(long)sig) == 0) {
+        if (waitpid(pid, &status, 0) < 0 || WIFEXITED(status) || WIFSIGNALED(status)) break;
+        sig = 0;
+        if (WSTOPSIG(status) == (SIGTRAP | 0x80)) stops++;
+        else if (WSTOPSIG(status) != SIGTRAP) sig = WSTOPSIG(status); // pass real signals on
+    }
+    return stops / 2; // one stop on entry, one on exit
+}
+
+static void bench_event_core(void) {
+    // Interactive-style input: prompts, commands, errors and blank lines
+    static const char *lines[] = { "/bin/true", "nosuchcommand", "true & /bin/true", "" };
+    long count = 400L * scale;
+    char path[] = "/tmp/wish-bench-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return;
+    FILE *f = fdopen(fd, "w");
+    for (long i = 0; i < count; i++) {
+        fprintf(f, "%s\n", lines[i % 4]);
+    }
+    fclose(f);
+
+    const char *modes[] = { "off", "on" };
+    for (int m = 0; m < 2; m++) {
+        long calls = count_shell_syscalls(path, modes[m]);
+        if (calls < 0) continue;
+        char name[64];
+        snprintf(name, sizeof(name), "shell_syscalls_per_line_uring_%s", modes[m]);
+        report(name, "syscalls/line", (double)calls / count, count);
+    }
+    unlink(path);
+}
+
+int main(void) {
+    const char *env = getenv("BENCH_SCALE");
+    if (env && atoi(env) > 0) scale = atoi(env);
+
+    // Forked before anything is allocated, like the shell does; the variable is
+    // cleared again so the wish processes started below do not inherit it
+    setenv("WISH_ZYGOTE", "on", 1);
+    zygote_init_from_env();
+    unsetenv("WISH_ZYGOTE");
+
+    shell_path_count = 1;
+    shell_paths = malloc(sizeof(char*));
+    shell_paths[0] = strdup("/bin");
+
+#ifdef __OPTIMIZE__
+    const char *optimized = "true";
+#else
+    const char *optimized = "false";
+#endif
+    printf("{\n  \"benchmark\": \"wish\",\n  \"timestamp\": %ld,\n  \"scale\": %d,\n  \"optimized\": %s,\n  \"results\": [",
+           (long)time(NULL), scale, optimized);
+    bench_tokenize();
+    bench_line_scan();
+    bench_resolve();
+    bench_completion();
+    bench_history();
+    bench_glob();
+    bench_launch();
+    bench_startup();
+    bench_batch();
+    bench_wide_lines();
+    bench_compiled_batch();
+    bench_trivial();
+    bench_serve();
+    bench_event_core();
+    printf("\n  ]\n}\n");
+    return 0;
+}
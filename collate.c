@@ -0,0 +1,262 @@
+#define _GNU_SOURCE // For pipe2, splice and memfd_create
+#include "collate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include "pipe_io.h"
+
+// Output kept on the heap per job before spilling into a memfd
+#define COLLATE_HEAP_LIMIT 65536
+#define COLLATE_MAX_EVENTS 64
+
+// One of a job's two output streams, replayed to the shell's fd of the same number
+typedef struct {
+    Capture *owner;
+    int dest_fd;         // STDOUT_FILENO or STDERR_FILENO
+    int read_fd;         // -1 before attach and after EOF
+    char *buf;           // heap part of the buffered output
+    size_t len;
+    int memfd;           // spill file, -1 until needed
+    off_t mem_len;
+} Stream;
+
+struct Capture {
+    Capture *next;       // submission order
+    bool finished;       // job done and what it wrote collected
+    Stream streams[2];   // stdout, stderr
+};
+
+static bool enabled = false;
+static Capture *head = NULL; // oldest block not yet emitted; it streams live
+static Capture *tail = NULL;
+static int epoll_fd = -1;
+static int wake_registered = -1;
+static int open_pipes = 0;
+
+bool collate_enabled(void) {
+    return enabled;
+}
+
+void collate_set_enabled(bool on) {
+    enabled = on;
+}
+
+Capture *collate_reserve(void) {
+    Capture *capture = calloc(1, sizeof(Capture));
+    if (!capture) return NULL;
+    for (int i = 0; i < 2; i++) {
+        Stream *stream = &capture->streams[i];
+        stream->owner = capture;
+        stream->dest_fd = i == 0 ? STDOUT_FILENO : STDERR_FILENO;
+        stream->read_fd = -1;
+        stream->memfd = -1;
+    }
+    if (tail) tail->next = capture;
+    else head = capture;
+    tail = capture;
+    return capture;
+}
+
+// Creates one stream's pipe and starts watching it
+static int attach_stream(Stream *stream, int *write_fd) {
+    int fds[2];
+    if (make_pipe(fds) != 0) return -1;
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = stream };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fds[0], &ev) != 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    stream->read_fd = fds[0];
+    *write_fd = fds[1];
+    open_pipes++;
+    return 0;
+}
+
+static void close_pipe(Stream *stream) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, stream->read_fd, NULL);
+    close(stream->read_fd);
+    stream->read_fd = -1;
+    open_pipes--;
+}
+
+int collate_attach(Capture *capture, int *out_fd, int *err_fd) {
+    if (epoll_fd < 0) {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd < 0) return -1;
+    }
+    if (attach_stream(&capture->streams[0], out_fd) != 0) return -1;
+    if (attach_stream(&capture->streams[1], err_fd) != 0) {
+        close_pipe(&capture->streams[0]);
+        close(*out_fd);
+        return -1;
+    }
+    return 0;
+}
+
+static void write_out(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+// Writes everything buffered for the stream to its destination
+static void flush_buffered(Stream *stream) {
+    if (stream->dest_fd == STDOUT_FILENO) fflush(stdout);
+    if (stream->len > 0) {
+        write_out(stream->dest_fd, stream->buf, stream->len);
+        stream->len = 0;
+    }
+    if (stream->memfd >= 0) {
+        off_t off = 0;
+        while (off < stream->mem_len) {
+            ssize_t n = sendfile(stream->dest_fd, stream->memfd, &off, stream->mem_len - off);
+            if (n <= 0) break;
+        }
+        close(stream->memfd);
+        stream->memfd = -1;
+        stream->mem_len = 0;
+    }
+}
+
+// Keeps data that is not allowed out yet: heap first, then the memfd
+static void buffer_data(Stream *stream, const char *data, size_t len) {
+    if (stream->memfd < 0 && stream->len + len <= COLLATE_HEAP_LIMIT) {
+        if (!stream->buf) stream->buf = malloc(COLLATE_HEAP_LIMIT);
+        if (stream->buf) {
+            memcpy(stream->buf + stream->len, data, len);
+            stream->len += len;
+            return;
+        }
+    }
+    if (stream->memfd < 0) {
+        stream->memfd = memfd_create("wish-collate", MFD_CLOEXEC);
+        if (stream->memfd < 0) {
+            // Nowhere to keep it; emitting out of order beats losing it
+            write_out(stream->dest_fd, data, len);
+            return;
+        }
+    }
+    ssize_t n = pwrite(stream->memfd, data, len, stream->mem_len);
+    if (n > 0) stream->mem_len += n;
+}
+
+// Reads whatever is available from the stream's pipe, without blocking. The
+// head block goes straight out; a block that has already spilled is spliced
+// into its memfd.
+static void drain(Stream *stream) {
+    char buf[16384];
+    while (stream->read_fd >= 0) {
+        ssize_t n;
+        if (stream->owner == head) {
+            if (stream->dest_fd == STDOUT_FILENO) fflush(stdout);
+            n = read(stream->read_fd, buf, sizeof(buf));
+            if (n > 0) write_out(stream->dest_fd, buf, n);
+        } else if (stream->memfd >= 0) {
+            loff_t off = stream->mem_len;
+            n = splice(stream->read_fd, NULL, stream->memfd, &off, 1 << 20, SPLICE_F_MOVE);
+            if (n > 0) stream->mem_len += n;
+            if (n < 0 && errno == EINVAL) {
+                n = read(stream->read_fd, buf, sizeof(buf));
+                if (n > 0) buffer_data(stream, buf, n);
+            }
+        } else {
+            n = read(stream->read_fd, buf, sizeof(buf));
+            if (n > 0) buffer_data(stream, buf, n);
+        }
+        if (n == 0) {
+            close_pipe(stream);
+        } else if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return;
+            close_pipe(stream);
+        }
+    }
+}
+
+// A block has been emitted while something its job started in the background
+// still holds the pipe open. Whatever that writes later is forwarded by a
+// detached thread, so the shell never waits for it.
+static void release_stream(Stream *stream) {
+    if (stream->read_fd < 0) return;
+    int in_fd = stream->read_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, in_fd, NULL);
+    stream->read_fd = -1;
+    open_pipes--;
+    fcntl(in_fd, F_SETFL, 0);
+    int out_fd = fcntl(stream->dest_fd, F_DUPFD_CLOEXEC, 0);
+    if (out_fd < 0 || splice_pump_detach(in_fd, out_fd) != 0) {
+        // Nowhere to forward it; the writer gets EPIPE instead of blocking us
+        close(in_fd);
+        if (out_fd >= 0) close(out_fd);
+    }
+}
+
+// Emits finished blocks in order; the next unfinished block becomes the live one
+static void emit_ready(void) {
+    while (head && head->finished) {
+        Capture *done = head;
+        for (int i = 0; i < 2; i++) {
+            flush_buffered(&done->streams[i]);
+            release_stream(&done->streams[i]);
+            free(done->streams[i].buf);
+        }
+        head = done->next;
+        if (!head) tail = NULL;
+        free(done);
+    }
+    if (head) {
+        flush_buffered(&head->streams[0]);
+        flush_buffered(&head->streams[1]);
+    }
+}
+
+void collate_close(Capture *capture) {
+    // The job's own processes have exited, so everything they wrote is
+    // already in the pipes; only background descendants can still add more
+    drain(&capture->streams[0]);
+    drain(&capture->streams[1]);
+    capture->finished = true;
+    emit_ready();
+}
+
+bool collate_wait(int wake_fd) {
+    if (open_pipes == 0 || epoll_fd < 0) return false;
+    if (wake_fd >= 0 && wake_fd != wake_registered) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev) != 0) return false;
+        wake_registered = wake_fd;
+    }
+    while (open_pipes > 0) {
+        struct epoll_event events[COLLATE_MAX_EVENTS];
+        int n = epoll_wait(epoll_fd, events, COLLATE_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        bool woke = false;
+        for (int e = 0; e < n; e++) {
+            Stream *stream = events[e].data.ptr;
+            if (!stream) {
+                woke = true;
+                continue;
+            }
+            if (stream->read_fd >= 0) drain(stream);
+        }
+        if (woke) return true;
+    }
+    return false;
+}
@@ -0,0 +1,36 @@
+#ifndef COLLATE_H
+#define COLLATE_H
+
+#include <stdbool.h>
+
+// Opt-in output collation for parallel commands. Each job's stdout and stderr
+// go to two pipes that the shell drains; output is written to the shell's
+// stdout and stderr as one contiguous block per job, in submission order. The
+// oldest unfinished job streams live, later ones are buffered (on the heap up
+// to a small limit, then in a memfd) until their turn. Output from background
+// processes a job leaves behind is forwarded as it comes once the job's block
+// is out; the shell never waits for them.
+
+typedef struct Capture Capture;
+
+bool collate_enabled(void);
+void collate_set_enabled(bool on);
+
+// Reserves the next output slot in submission order
+Capture *collate_reserve(void);
+
+// Creates the capture pipes when the job starts; *out_fd and *err_fd receive
+// the ends to hand to the child as stdout and stderr (the caller closes them
+// after spawning). Returns 0 or -1.
+int collate_attach(Capture *capture, int *out_fd, int *err_fd);
+
+// Called once the job has finished: collects what it wrote without blocking
+// and emits every block whose turn has come
+void collate_close(Capture *capture);
+
+// Drains capture pipes until wake_fd becomes readable (or nothing is left to
+// drain). Lets callers that are about to block on child exits keep pipes flowing.
+// Returns true if wake_fd woke it, false if there was nothing to drain.
+bool collate_wait(int wake_fd);
+
+#endif // COLLATE_H
@@ -2,138 +2,500 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 #include "wish.h"
 #include "utils.h"
+#include "path_cache.h"
+#include "jobs.h"
+#include "parse.h"
+#include "collate.h"
+#include "stats.h"
+#include "trace.h"
+#include "plan_cache.h"
+#include "inproc.h"
+#include "dag.h"
+#include "affinity.h"
+#include "uring.h"
+#include "history.h"
+#include "env.h"
+#include "zygote.h"
+#include "wildcard.h"
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
-// Forward declarations for helpers
-static int handle_builtin(char **argv);
+// Built-in commands. Each returns after reporting its own errors.
 
-// Handle built-in commands: exit, cd, path
-static int handle_builtin(char **argv) {
-    if (!argv || !argv[0]) return 0;
-    if (strcmp(argv[0], "exit") == 0) {
-        if (argv[1] != NULL) {
-            shell_error(E2BIG);
-            return 1;
-        }
-        exit(0);
-    } else if (strcmp(argv[0], "cd") == 0) {
-        if (!argv[1] || argv[2]) {
+// Set while a command server request runs (see process_detached_view)
+static bool detached = false;
+static bool exit_requested = false;
+
+static void builtin_exit(char **argv) {
+    if (argv[1] != NULL) {
+        shell_error(E2BIG);
+        return;
+    }
+    // A client's `exit` ends its session, not the server
+    if (detached) {
+        exit_requested = true;
+        return;
+    }
+    sched_wait_all();
+    exit(0);
+}
+
+static void builtin_cd(char **argv) {
+    if (!argv[1] || argv[2]) {
+        shell_error(EINVAL);
+        return;
+    }
+    if (chdir(argv[1]) != 0) {
+        shell_error(ENOENT);
+        return;
+    }
+    zygote_note_chdir();
+    plan_cache_flush(); // plans may hold ./relative executables
+}
+
+// export [NAME=value ...]: sets variables for the programs launched after it.
+// A bare NAME is accepted and changes nothing, since every variable is exported.
+static void builtin_export(char **argv) {
+    if (!argv[1]) {
+        env_print();
+        return;
+    }
+    for (int i = 1; argv[i]; i++) {
+        if (strchr(argv[i], '=')) {
+            if (env_put(argv[i]) != 0) print_errno();
+        } else if (!env_valid_name(argv[i], strlen(argv[i]))) {
             shell_error(EINVAL);
-            return 1;
-        }
-        if (chdir(argv[1]) != 0) {
-            shell_error(ENOENT);
         }
-        return 1;
-    } else if (strcmp(argv[0], "path") == 0) {
-        // Reset shell_paths
-        for (int i = 0; i < shell_path_count; i++) {
-            free(shell_paths[i]);
+    }
+}
+
+static void builtin_unset(char **argv) {
+    if (!argv[1]) {
+        shell_error(EINVAL);
+        return;
+    }
+    for (int i = 1; argv[i]; i++) {
+        if (env_unset(argv[i]) != 0) print_errno();
+    }
+}
+
+static void builtin_path(char **argv) {
+    // Reset shell_paths
+    for (int i = 0; i < shell_path_count; i++) {
+        free(shell_paths[i]);
+    }
+    free(shell_paths);
+    shell_path_count = 0;
+    int n = 0;
+    while (argv[1 + n]) n++;
+    if (n > 0) {
+        shell_paths = malloc(sizeof(char*) * n);
+        for (int i = 0; i < n; i++) {
+            shell_paths[i] = strdup(argv[1 + i]);
         }
-        free(shell_paths);
-        shell_path_count = 0;
-        int n = 0;
-        while (argv[1 + n]) n++;
-        if (n > 0) {
-            shell_paths = malloc(sizeof(char*) * n);
-            for (int i = 0; i < n; i++) {
-                shell_paths[i] = strdup(argv[1 + i]);
-            }
-            shell_path_count = n;
+        shell_path_count = n;
+    } else {
+        shell_paths = NULL;
+    }
+    path_cache_flush();
+    plan_cache_flush();
+}
+
+static void builtin_hash(char **argv) {
+    if (!argv[1]) {
+        path_cache_print_stats();
+    } else if (strcmp(argv[1], "-r") == 0 && !argv[2]) {
+        path_cache_flush();
+    } else {
+        shell_error(EINVAL);
+    }
+}
+
+static void builtin_jobs(char **argv) {
+    if (!argv[1]) {
+        printf("max: %d running: %d queued: %d\n",
+               sched_get_max_jobs(), sched_running_count(), sched_queued_count());
+    } else if (strcmp(argv[1], "-j") == 0 && argv[2] && !argv[3]) {
+        char *end;
+        long n = strtol(argv[2], &end, 10);
+        if (*end != '\0' || end == argv[2] || n < 0 || n > 1000000) {
+            shell_error(EINVAL);
         } else {
-            shell_paths = NULL;
+            sched_set_max_jobs((int)n);
         }
-        return 1;
+    } else {
+        shell_error(EINVAL);
     }
-    return 0;
 }
 
-// Helper to execute a single command (handles redirection)
-static int execute_single_command(char *cmd_str) {
-    if (!cmd_str || *cmd_str == '\0') return 0; // Empty command
+// Shared by the on/off switches: prints the state, or sets it from "on"/"off"
+static void toggle_setting(char **argv, bool (*get)(void), void (*set)(bool)) {
+    if (!argv[1]) {
+        printf("%s: %s\n", argv[0], get() ? "on" : "off");
+    } else if (argv[2]) {
+        shell_error(E2BIG);
+    } else if (strcmp(argv[1], "on") == 0) {
+        set(true);
+    } else if (strcmp(argv[1], "off") == 0) {
+        set(false);
+    } else {
+        shell_error(EINVAL);
+    }
+}
+
+static void builtin_collate(char **argv) {
+    toggle_setting(argv, collate_enabled, collate_set_enabled);
+}
+
+static void builtin_inproc(char **argv) {
+    if (!argv[1]) {
+        printf("inproc: %s saved launches: %lu\n", inproc_enabled() ? "on" : "off",
+               inproc_saved_launches());
+        return;
+    }
+    toggle_setting(argv, inproc_enabled, inproc_set_enabled);
+}
 
-    char *redir_target = NULL;
-    if (parse_redirection(cmd_str, &redir_target) != 0) {
+static void builtin_dag(char **argv) {
+    toggle_setting(argv, dag_enabled, dag_set_enabled);
+}
+
+static void builtin_wait(char **argv) {
+    if (argv[1]) {
+        shell_error(E2BIG);
+        return;
+    }
+    // A server request is answered once its own commands finish; waiting
+    // for every client's would stall the server
+    if (detached) return;
+    sched_wait_all();
+}
+
+// affinity [inherit | rr | spread | pack [CPULIST]]
+static void builtin_affinity(char **argv) {
+    AffinityPolicy policy;
+    if (!argv[1]) {
+        affinity_print();
+    } else if (affinity_parse_policy(argv[1], &policy) != 0 ||
+               (argv[2] && (policy == AFFINITY_INHERIT || argv[3]))) {
         shell_error(EINVAL);
-        return -1;
+    } else if (affinity_configure(policy, argv[2]) != 0) {
+        print_errno();
     }
+}
 
-    char *tokens[512 / 2 + 1];
-    char *cmd_copy = strdup(cmd_str);
-    if (!cmd_copy) {
-        if (redir_target) free(redir_target);
-        shell_error(ENOMEM);
-        return -1;
+// history [N]: the last N entries, or all of them
+static void builtin_history(char **argv) {
+    if (!argv[1]) {
+        history_print(-1);
+        return;
+    }
+    char *end;
+    long n = strtol(argv[1], &end, 10);
+    if (argv[2] || *end != '\0' || end == argv[1] || n < 0 || n > INT_MAX) {
+        shell_error(EINVAL);
+    } else {
+        history_print((int)n);
     }
+}
 
-    int token_count = tokenize_input(cmd_copy, tokens, 512 / 2 + 1);
-    if (token_count == 0) {
-        free(cmd_copy);
-        if (redir_target) free(redir_target);
-        return 0;
+static void builtin_parsestat(char **argv) {
+    if (argv[1]) {
+        shell_error(E2BIG);
+        return;
+    }
+    ParseStats stats;
+    parse_get_stats(&stats);
+    printf("lines: %lu mallocs: %lu arena bytes: %zu\n",
+           stats.lines, stats.mallocs, stats.arena_bytes);
+}
+
+static void builtin_stats(char **argv) {
+    if (!argv[1]) {
+        stats_print();
+    } else if (strcmp(argv[1], "-r") == 0 && !argv[2]) {
+        stats_reset();
+    } else {
+        shell_error(EINVAL);
     }
-    if (handle_builtin(tokens)) {
-        free(cmd_copy);
-        if (redir_target) free(redir_target);
+}
+
+static void builtin_plans(char **argv) {
+    if (!argv[1]) {
+        plan_cache_print_stats();
+    } else if (strcmp(argv[1], "-r") == 0 && !argv[2]) {
+        plan_cache_flush();
+    } else {
+        shell_error(EINVAL);
+    }
+}
+
+static void builtin_trace(char **argv) {
+    if (!argv[1]) {
+        printf("trace: %s\n", trace_active ? "on" : "off");
+    } else if (strcmp(argv[1], "on") == 0 && argv[2] && !argv[3]) {
+        if (trace_start(argv[2]) != 0) print_errno();
+    } else if (strcmp(argv[1], "off") == 0 && !argv[2]) {
+        if (trace_stop() != 0) print_errno();
+    } else {
+        shell_error(EINVAL);
+    }
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(char **argv); // NULL for prefixes handled by process_command_view
+} Builtin;
+
+static const Builtin builtins[] = {
+    { "exit", builtin_exit },
+    { "cd", builtin_cd },
+    { "path", builtin_path },
+    { "export", builtin_export },
+    { "unset", builtin_unset },
+    { "hash", builtin_hash },
+    { "jobs", builtin_jobs },
+    { "collate", builtin_collate },
+    { "inproc", builtin_inproc },
+    { "dag", builtin_dag },
+    { "wait", builtin_wait },
+    { "affinity", builtin_affinity },
+    { "history", builtin_history },
+    { "parsestat", builtin_parsestat },
+    { "stats", builtin_stats },
+    { "plans", builtin_plans },
+    { "trace", builtin_trace },
+    { "time", NULL }, // listed so it cannot start a later pipeline stage
+    { NULL, NULL },
+};
+
+static const Builtin *find_builtin(const char *name) {
+    for (const Builtin *b = builtins; b->name; b++) {
+        if (strcmp(name, b->name) == 0) return b;
+    }
+    return NULL;
+}
+
+const char *builtin_name(int i) {
+    return i >= 0 && i < (int)(sizeof(builtins) / sizeof(builtins[0])) ? builtins[i].name : NULL;
+}
+
+static int is_builtin(const char *name) {
+    return find_builtin(name) != NULL;
+}
+
+// Runs argv if it names a builtin. Returns 1 if it did.
+static int handle_builtin(char **argv) {
+    if (!argv || !argv[0]) return 0;
+    const Builtin *b = find_builtin(argv[0]);
+    if (!b || !b->run) return 0;
+    // Builtins (cd, export, jobs) must observe every command queued before
+    // them, and on a labelled line run after its dependencies; a server
+    // request must not wait on other clients' commands
+    if (!detached) {
+        sched_wait_node_ready();
+        sched_drain_queue();
+    }
+    b->run(argv);
+    return 1;
+}
+
+// resolve_executable, with its cost recorded for `stats` and the tracer
+static int lookup_program(const char *name, char *out, size_t out_len) {
+    long long start = monotonic_now_ns();
+    int found = resolve_executable(name, out, out_len);
+    stats_record_lookup(monotonic_now_ns() - start);
+    if (trace_active) trace_end(TRACE_RESOLVE, start, name);
+    return found;
+}
+
+// lookup_program into a heap copy, for stage lists of any length. Returns
+// NULL with errno set to ENOENT or ENOMEM.
+static char *lookup_program_copy(const char *name) {
+    char path[PATH_MAX];
+    if (!lookup_program(name, path, sizeof(path))) {
+        errno = ENOENT;
+        return NULL;
+    }
+    return strdup(path);
+}
+
+// Frees the programs of a stage list built with lookup_program_copy, and the list
+static void free_programs(SchedStage *stages, int count) {
+    for (int s = 0; s < count; s++) free((char *)stages[s].program);
+    free(stages);
+}
+
+static int has_time_prefix(const Command *cmd) {
+    return !cmd->invalid && cmd->arg_count > 0 && strcmp(cmd->name, "time") == 0;
+}
+
+// Drops a leading `time` word from cmd. Returns 1 if it was there.
+static int strip_time_prefix(Command *cmd) {
+    if (!has_time_prefix(cmd)) return 0;
+    cmd->args++;
+    cmd->arg_count--;
+    cmd->name = cmd->args[0];
+    return 1;
+}
+
+// Queues one pipeline, or runs a plain command inside the shell when an
+// in-process utility covers it and it is the only pipeline on its line (solo).
+// Returns 0, or -1 with errno set.
+static int submit_group(const SchedStage *stages, int count, const char *redir_target, int flags, bool solo) {
+    // `time` measures the real program. The commands of an `&` line run in
+    // parallel only as children. In the concurrent batch mode a line must not
+    // block the shell, nor run before the lines it depends on. A server
+    // request's output goes to a client that may be slow to read it.
+    bool dag = dag_enabled();
+    // Output queued on the ring goes out before anything this command writes
+    uring_flush();
+    if (count == 1 && solo && !(flags & SCHED_TIMED) && !detached &&
+        (!dag || sched_current_node_ready())) {
+        int status = inproc_run(stages[0].program, stages[0].argv, redir_target, !dag);
+        if (status != INPROC_DECLINED) {
+            if (status > 0) sched_node_set_status(-1, status);
+            return status < 0 ? -1 : 0;
+        }
+    }
+    return sched_submit_pipeline(stages, count, redir_target, flags);
+}
+
+// Helper to execute a single parsed command (handles builtins and redirection)
+static int run_command(Command *cmd, int flags, bool solo) {
+    if (cmd->invalid) {
+        shell_error(EINVAL);
+        return -1;
+    }
+    if (cmd->arg_count == 0) return 0; // Empty command
+
+    if (handle_builtin(cmd->args)) {
         return 0;
     }
     if (shell_path_count == 0) {
         shell_error(ENOENT);
-        free(cmd_copy);
-        if (redir_target) free(redir_target);
         return -1;
     }
-    char fullpath[1024];
-    int found = 0;
-    if (tokens[0][0] == '/' || (tokens[0][0] == '.' && tokens[0][1] == '/')) {
-        if (access(tokens[0], X_OK) == 0) {
-            strncpy(fullpath, tokens[0], sizeof(fullpath) - 1);
-            fullpath[sizeof(fullpath) - 1] = '\0';
-            found = 1;
-        }
-    } else {
-        for (int i = 0; i < shell_path_count; i++) {
-            snprintf(fullpath, sizeof(fullpath), "%s/%s", shell_paths[i], tokens[0]);
-            if (access(fullpath, X_OK) == 0) {
-                found = 1;
-                break;
-            }
+    char fullpath[PATH_MAX];
+    if (!lookup_program(cmd->name, fullpath, sizeof(fullpath))) {
+        shell_error(ENOENT);
+        return -1;
+    }
+    SchedStage stage = { fullpath, cmd->args };
+    if (submit_group(&stage, 1, cmd->redir_target, flags, solo) != 0) {
+        print_errno();
+        return -1;
+    }
+    return 0;
+}
+
+// Helper to execute the stages of a pipeline (a | b | c) as one job
+static int run_pipeline(Command *stages, int count, int flags) {
+    for (int s = 0; s < count; s++) {
+        // Builtins change the shell itself, so they cannot run as a pipeline stage
+        if (stages[s].invalid || is_builtin(stages[s].name)) {
+            shell_error(EINVAL);
+            return -1;
         }
     }
-    if (!found) {
+    if (shell_path_count == 0) {
         shell_error(ENOENT);
-        free(cmd_copy);
-        if (redir_target) free(redir_target);
         return -1;
     }
-    pid_t pid = fork();
-    if (pid < 0) {
-        shell_error(EAGAIN);
-        free(cmd_copy);
-        if (redir_target) free(redir_target);
+    SchedStage *sched_stages = calloc(count, sizeof(SchedStage));
+    int ret = -1;
+    if (!sched_stages) {
+        shell_error(ENOMEM);
         return -1;
-    } else if (pid == 0) {
-        if (redir_target) {
-            int fd = open(redir_target, O_CREAT | O_WRONLY | O_TRUNC, 0644);
-            if (fd < 0) {
-                shell_error(EACCES);
-                exit(1);
-            }
-            dup2(fd, STDOUT_FILENO);
-            dup2(fd, STDERR_FILENO);
-            close(fd);
+    }
+    for (int s = 0; s < count; s++) {
+        sched_stages[s].program = lookup_program_copy(stages[s].name);
+        if (!sched_stages[s].program) {
+            shell_error(errno == ENOMEM ? ENOMEM : ENOENT);
+            goto done;
         }
-        execv(fullpath, tokens);
-        shell_error(ENOEXEC);
-        exit(1);
+        sched_stages[s].argv = stages[s].args;
+    }
+    if (sched_submit_pipeline(sched_stages, count, stages[count - 1].redir_target, flags) != 0) {
+        print_errno();
+        goto done;
     }
-    free(cmd_copy);
-    if (redir_target) free(redir_target);
+    ret = 0;
+done:
+    free_programs(sched_stages, count);
+    return ret;
+}
+
+// Number of Commands in the pipeline starting at cmds[i]
+static int pipeline_length(const Command *cmds, int i, int cmd_count) {
+    int stages = 1;
+    while (cmds[i + stages - 1].pipe_next && i + stages < cmd_count) stages++;
+    return stages;
+}
+
+// Resolves a parsed line made only of external commands into a cached plan.
+// Returns NULL for lines with builtins, errors or empty commands; those run
+// command by command, which also reports their errors.
+static const Plan *compile_plan(const char *line, size_t len, Command *cmds, int cmd_count) {
+    if (shell_path_count == 0 || cmd_count == 0) return NULL;
+    PlanGroup *groups = malloc(sizeof(PlanGroup) * cmd_count);
+    SchedStage *stages = calloc(cmd_count, sizeof(SchedStage));
+    const Plan *plan = NULL;
+    int group_count = 0;
+    if (!groups || !stages) goto done;
+    for (int i = 0; i < cmd_count;) {
+        int count = pipeline_length(cmds, i, cmd_count);
+        int timed = has_time_prefix(&cmds[i]);
+        PlanGroup *group = &groups[group_count++];
+        group->stages = &stages[i];
+        group->stage_count = count;
+        group->redir_target = cmds[i + count - 1].redir_target;
+        group->flags = timed ? SCHED_TIMED : 0;
+        for (int s = i; s < i + count; s++) {
+            int skip = s == i ? timed : 0;
+            char **argv = cmds[s].args + skip;
+            if (cmds[s].invalid || cmds[s].arg_count - skip == 0 || is_builtin(argv[0])) goto done;
+            stages[s].program = lookup_program_copy(argv[0]);
+            if (!stages[s].program) goto done;
+            stages[s].argv = argv;
+        }
+        i += count;
+    }
+    plan = plan_cache_insert(line, len, groups, group_count);
+done:
+    free(groups);
+    if (stages) free_programs(stages, cmd_count);
+    return plan;
+}
+
+static void run_plan(const Plan *plan) {
+    for (int g = 0; g < plan->group_count; g++) {
+        const PlanGroup *group = &plan->groups[g];
+        if (submit_group(group->stages, group->stage_count, group->redir_target, group->flags,
+                         plan->group_count == 1) != 0) {
+            print_errno();
+        }
+    }
+}
+
+// Appends part to a NULL-terminated list, keeping room for the terminator.
+// Returns 0, or -1 (the list is freed) when out of memory.
+static int append_part(char ***parts, size_t *cap, size_t *cnt, char *part) {
+    if (*cnt + 1 >= *cap) {
+        *cap *= 2;
+        char **new_parts = realloc(*parts, sizeof(char*) * *cap);
+        if (!new_parts) {
+            free(*parts);
+            return -1;
+        }
+        *parts = new_parts;
+    }
+    (*parts)[(*cnt)++] = part;
     return 0;
 }
 
@@ -148,38 +510,13 @@ char **split_parallel_commands(char *linecopy, int *out_count) {
     char *p = linecopy;
     while (1) {
         char *amp = strchr(p, '&');
-        if (!amp) {
-            char *part = trim_whitespace(p);
-            if (*part != '\0') {
-                if (cnt >= cap) {
-                    cap *= 2;
-                    char **new_parts = realloc(parts, sizeof(char*) * cap);
-                    if (!new_parts) {
-                        free(parts);
-                        shell_error(ENOMEM);
-                        return NULL;
-                    }
-                    parts = new_parts;
-                }
-                parts[cnt++] = part;
-            }
-            break;
-        }
-        *amp = '\0';
+        if (amp) *amp = '\0';
         char *part = trim_whitespace(p);
-        if (*part != '\0') {
-            if (cnt >= cap) {
-                cap *= 2;
-                char **new_parts = realloc(parts, sizeof(char*) * cap);
-                if (!new_parts) {
-                    free(parts);
-                    shell_error(ENOMEM);
-                    return NULL;
-                }
-                parts = new_parts;
-            }
-            parts[cnt++] = part;
+        if (*part != '\0' && append_part(&parts, &cap, &cnt, part) != 0) {
+            shell_error(ENOMEM);
+            return NULL;
         }
+        if (!amp) break;
         p = amp + 1;
     }
     parts[cnt] = NULL;
@@ -228,126 +565,106 @@ int parse_redirection(char *cmd, char **out_target) {
     return 1;
 }
 
-// Implementation of process_command_line (stub, should be filled in with actual logic)
+// Implementation of process_command_line
 int process_command_line(char *line) {
     if (!line || *line == '\0') return 0;
-    char *linecopy = strdup(line);
-    if (!linecopy) {
-        shell_error(ENOMEM);
-        return -1;
+    return process_command_view(line, strlen(line));
+}
+
+// Waits for the line's jobs, or in the concurrent batch mode and for server
+// requests lets them run on
+static void finish_line(int node) {
+    if (dag_enabled() || detached) {
+        dag_end_line(node);
+    } else {
+        sched_wait_all();
+    }
+}
+
+// Runs a line whose annotation dag_begin_line has stripped. parsed holds its
+// commands when they were parsed ahead of time; otherwise the text is parsed here.
+static int run_line(const char *line, size_t len, int node, Command *parsed, int parsed_count) {
+    // A line seen before goes straight to the scheduler
+    const Plan *plan = plan_cache_lookup(line, len);
+    if (plan) {
+        run_plan(plan);
+        finish_line(node);
+        return 0;
     }
-    int cmd_count = 0;
-    char **cmds = split_parallel_commands(linecopy, &cmd_count);
+
+    int cmd_count = parsed_count;
+    Command *cmds = parsed;
     if (!cmds) {
-        free(linecopy);
-        return -1;
+        long long parse_start = trace_begin();
+        cmds = parse_line(line, len, &cmd_count);
+        trace_end(TRACE_PARSE, parse_start, cmds && cmd_count > 0 ? cmds[0].name : NULL);
+        if (!cmds) {
+            parse_reset();
+            dag_end_line(node);
+            shell_error(ENOMEM);
+            return -1;
+        }
     }
-    pid_t *pids = malloc(sizeof(pid_t) * cmd_count);
-    if (!pids) {
-        free(cmds);
-        free(linecopy);
+    // Globbed lines depend on the file system, so they are never cached as plans
+    int patterns = wildcard_expand(cmds, cmd_count);
+    if (patterns < 0) {
+        parse_reset();
+        dag_end_line(node);
         shell_error(ENOMEM);
         return -1;
     }
-    int pid_count = 0;
-    for (int i = 0; i < cmd_count; i++) {
-        if (cmds[i] && *cmds[i] != '\0') {
-            // Work on a copy so we don't modify the original for other commands
-            char *cmd_work = strdup(cmds[i]);
-            if (!cmd_work) {
-                shell_error(ENOMEM);
-                continue;
-            }
-            char *redir_target = NULL;
-            if (parse_redirection(cmd_work, &redir_target) < 0) {
-                shell_error(EINVAL);
-                free(cmd_work);
-                if (redir_target) free(redir_target);
-                continue;
-            }
-            char *tokens[512 / 2 + 1];
-            int token_count = tokenize_input(cmd_work, tokens, 512 / 2 + 1);
-            if (token_count == 0) {
-                free(cmd_work);
-                if (redir_target) free(redir_target);
-                continue;
-            }
-            if (handle_builtin(tokens)) {
-                free(cmd_work);
-                if (redir_target) free(redir_target);
-                continue;
-            }
-            if (shell_path_count == 0) {
-                shell_error(ENOENT);
-                free(cmd_work);
-                if (redir_target) free(redir_target);
-                continue;
-            }
-            char fullpath[1024];
-            int found = 0;
-            if (tokens[0][0] == '/' || (tokens[0][0] == '.' && tokens[0][1] == '/')) {
-                if (access(tokens[0], X_OK) == 0) {
-                    strncpy(fullpath, tokens[0], sizeof(fullpath) - 1);
-                    fullpath[sizeof(fullpath) - 1] = '\0';
-                    found = 1;
-                }
-            } else {
-                for (int j = 0; j < shell_path_count; j++) {
-                    snprintf(fullpath, sizeof(fullpath), "%s/%s", shell_paths[j], tokens[0]);
-                    if (access(fullpath, X_OK) == 0) {
-                        found = 1;
-                        break;
-                    }
-                }
-            }
-            if (!found) {
-                shell_error(ENOENT);
-                free(cmd_work);
-                if (redir_target) free(redir_target);
-                continue;
-            }
-            pid_t pid = fork();
-            if (pid < 0) {
-                shell_error(EAGAIN);
-                free(cmd_work);
-                if (redir_target) free(redir_target);
-                continue;
-            } else if (pid == 0) {
-                if (redir_target) {
-                    int fd = open(redir_target, O_CREAT | O_WRONLY | O_TRUNC, 0644);
-                    if (fd < 0) {
-                        shell_error(EACCES);
-                        exit(1);
-                    }
-                    dup2(fd, STDOUT_FILENO);
-                    dup2(fd, STDERR_FILENO);
-                    close(fd);
-                }
-                execv(fullpath, tokens);
-                shell_error(ENOEXEC);
-                exit(1);
-            } else {
-                pids[pid_count++] = pid;
-
-                #ifdef DDEBUG
-                    fprintf(stderr, "[DEBUG] Created child PID: %d for command: %s\n", pid, tokens[0]);
-                #endif
-
-            }
-            free(cmd_work);
-            if (redir_target) free(redir_target);
+    plan = patterns == 0 ? compile_plan(line, len, cmds, cmd_count) : NULL;
+    if (plan) {
+        run_plan(plan);
+        finish_line(node);
+        parse_reset();
+        return 0;
+    }
+    for (int i = 0; i < cmd_count;) {
+        int stages = pipeline_length(cmds, i, cmd_count);
+        int flags = strip_time_prefix(&cmds[i]) ? SCHED_TIMED : 0;
+        if (flags && cmds[i].arg_count == 0) {
+            shell_error(EINVAL); // `time` needs a command
+        } else if (stages == 1) {
+            run_command(&cmds[i], flags, i == 0 && stages == cmd_count);
+        } else {
+            run_pipeline(&cmds[i], stages, flags);
         }
+        i += stages;
     }
-    for (int i = 0; i < pid_count; i++) {
-        waitpid(pids[i], NULL, 0);
+    finish_line(node);
+    parse_reset();
+    return 0;
+}
+
+int process_command_view(const char *line, size_t len) {
+    if (!line || len == 0) return 0;
+    int node = dag_begin_line(&line, &len);
+    if (node == DAG_ERROR) return -1;
+    return run_line(line, len, node, NULL, 0);
+}
 
-        #ifdef DDEBUG
-            fprintf(stderr, "[DEBUG] Child PID %d completed.\n", pids[i]);
-        #endif
+int process_parsed_view(const char *line, size_t len, size_t body_offset, Command *cmds, int cmd_count) {
+    if (!line || len == 0) return 0;
+    const char *body = line;
+    int node = dag_begin_line(&body, &len);
+    if (node == DAG_ERROR) return -1;
+    // Should the annotation end elsewhere after all, the text is the authority
+    bool matches = body == line + body_offset;
+    return run_line(body, len, node, matches ? cmds : NULL, matches ? cmd_count : 0);
+}
 
+int process_detached_view(const char *line, size_t len, int out_fd, int err_fd, bool *exited) {
+    int node = sched_node_open(NULL, 0);
+    if (node < 0) {
+        shell_error(ENOMEM);
+        return -1;
     }
-    free(pids);
-    free(cmds);
-    free(linecopy);
-    return 0;
+    sched_node_set_output(node, out_fd, err_fd);
+    detached = true;
+    exit_requested = false;
+    run_line(line, len, node, NULL, 0);
+    detached = false;
+    *exited = exit_requested;
+    return node;
 }
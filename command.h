@@ -1,9 +1,27 @@
 #ifndef COMMAND_H
 #define COMMAND_H
 
+#include <stddef.h>
+#include <stdbool.h>
+#include "parallel.h"
+
 // Command parsing and execution
 int process_command_line(char *line);
+int process_command_view(const char *line, size_t len);
+// Like process_command_view for a line parsed ahead of time (see batch_cache.h):
+// cmds are the commands of the text after its annotation, which starts at
+// body_offset. The Commands may be modified while the line runs.
+int process_parsed_view(const char *line, size_t len, size_t body_offset, Command *cmds, int cmd_count);
+// Runs a line for a client of the command server (see server.h) without
+// waiting for it: its jobs form a new scheduler node whose output goes to
+// out_fd/err_fd (-1 for the shell's own). Annotations are not interpreted.
+// Returns the node, or -1 if memory ran out. *exited is set if the line ran
+// `exit`, which ends the client's session instead of the shell.
+int process_detached_view(const char *line, size_t len, int out_fd, int err_fd, bool *exited);
 int parse_redirection(char *cmd, char **out_target);
 char **split_parallel_commands(char *linecopy, int *out_count);
 
+// Name of the i-th builtin, or NULL past the last one (for completion)
+const char *builtin_name(int i);
+
 #endif // COMMAND_H
@@ -0,0 +1,146 @@
+#define _GNU_SOURCE // For memrchr
+#include "complete.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "wish.h"
+#include "command.h"
+#include "program_array.h"
+
+// Characters that end a word for completion purposes
+#define WORD_BREAKS " \t&|>"
+
+// Appends prefix + name + suffix to the list
+static int add_item(Completions *c, int *cap, const char *prefix, size_t prefix_len,
+                    const char *name, const char *suffix) {
+    if (c->count >= *cap) {
+        int new_cap = *cap ? *cap * 2 : 32;
+        char **new_items = realloc(c->items, sizeof(char*) * new_cap);
+        if (!new_items) return -1;
+        c->items = new_items;
+        *cap = new_cap;
+    }
+    size_t name_len = strlen(name);
+    size_t suffix_len = strlen(suffix);
+    char *item = malloc(prefix_len + name_len + suffix_len + 1);
+    if (!item) return -1;
+    memcpy(item, prefix, prefix_len);
+    memcpy(item + prefix_len, name, name_len);
+    memcpy(item + prefix_len + name_len, suffix, suffix_len + 1);
+    c->items[c->count++] = item;
+    return 0;
+}
+
+static int compare_items(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// The same program may sit in several search directories
+static void sort_unique(Completions *c) {
+    qsort(c->items, c->count, sizeof(char*), compare_items);
+    int unique = 0;
+    for (int i = 0; i < c->count; i++) {
+        if (unique > 0 && strcmp(c->items[unique - 1], c->items[i]) == 0) {
+            free(c->items[i]);
+            continue;
+        }
+        c->items[unique++] = c->items[i];
+    }
+    c->count = unique;
+}
+
+// True if a word starting at pos names the command: it opens the line, follows
+// '&' or '|', or follows a leading `time`
+static bool in_command_position(const char *line, size_t pos) {
+    size_t i = pos;
+    while (i > 0 && (line[i - 1] == ' ' || line[i - 1] == '\t')) i--;
+    if (i == 0 || line[i - 1] == '&' || line[i - 1] == '|') return true;
+    return i >= 4 && strncmp(line + i - 4, "time", 4) == 0 && in_command_position(line, i - 4);
+}
+
+static int complete_command(Completions *c, int *cap, const char *word, size_t len) {
+    for (int i = 0; builtin_name(i); i++) {
+        if (strncmp(builtin_name(i), word, len) == 0 &&
+            add_item(c, cap, "", 0, builtin_name(i), "") != 0) return -1;
+    }
+    char *prefix = strndup(word, len);
+    if (!prefix) return -1;
+    for (int i = 0; i < shell_path_count; i++) {
+        const ProgramArray *programs = get_directory_programs(shell_paths[i]);
+        if (!programs) continue;
+        int matches;
+        int first = find_programs_with_prefix(programs, prefix, &matches);
+        for (int m = first; m < first + matches; m++) {
+            if (add_item(c, cap, "", 0, program_name(programs, m), "") != 0) {
+                free(prefix);
+                return -1;
+            }
+        }
+    }
+    free(prefix);
+    return 0;
+}
+
+static int complete_file(Completions *c, int *cap, const char *word, size_t len) {
+    const char *slash = memrchr(word, '/', len);
+    size_t dir_len = slash ? (size_t)(slash - word) + 1 : 0;
+    const char *base = word + dir_len;
+    size_t base_len = len - dir_len;
+    char *dir_path = dir_len ? strndup(word, dir_len) : strdup(".");
+    if (!dir_path) return -1;
+    DIR *dir = opendir(dir_path);
+    free(dir_path);
+    if (!dir) return 0; // nothing to offer
+    int status = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        const char *name = entry->d_name;
+        // Hidden entries only when the word asks for them
+        if (name[0] == '.' && (base_len == 0 || base[0] != '.')) continue;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) continue;
+        if (strncmp(name, base, base_len) != 0) continue;
+        bool is_dir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN) {
+            struct stat st;
+            is_dir = fstatat(dirfd(dir), name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+        }
+        if (add_item(c, cap, word, dir_len, name, is_dir ? "/" : "") != 0) {
+            status = -1;
+            break;
+        }
+    }
+    closedir(dir);
+    return status;
+}
+
+int complete_line(const char *line, size_t cursor, Completions *out) {
+    memset(out, 0, sizeof(*out));
+    size_t start = cursor;
+    while (start > 0 && !strchr(WORD_BREAKS, line[start - 1])) start--;
+    const char *word = line + start;
+    size_t len = cursor - start;
+    out->word_start = start;
+    out->is_command = in_command_position(line, start) && !memchr(word, '/', len);
+
+    int cap = 0;
+    int status = out->is_command ? complete_command(out, &cap, word, len)
+                                 : complete_file(out, &cap, word, len);
+    if (status != 0) {
+        completions_free(out);
+        errno = ENOMEM;
+        return -1;
+    }
+    sort_unique(out);
+    return 0;
+}
+
+void completions_free(Completions *c) {
+    for (int i = 0; i < c->count; i++) free(c->items[i]);
+    free(c->items);
+    c->items = NULL;
+    c->count = 0;
+}
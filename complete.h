@@ -0,0 +1,24 @@
+#ifndef COMPLETE_H
+#define COMPLETE_H
+
+#include <stddef.h>
+
+// Tab completion for the line editor. A word in command position completes to
+// builtins and to the executables of the current shell_paths (looked up by
+// binary search in the cached per-directory indexes); any other word, or one
+// containing '/', completes to file names.
+
+typedef struct {
+    char **items;      // full replacements for the word, sorted and unique; directories end in '/'
+    int count;
+    size_t word_start; // the word being completed is line[word_start, cursor)
+    int is_command;    // completing a command name
+} Completions;
+
+// Collects the completions for the word that ends at cursor. Returns 0, or -1
+// with errno set.
+int complete_line(const char *line, size_t cursor, Completions *out);
+
+void completions_free(Completions *c);
+
+#endif // COMPLETE_H
@@ -0,0 +1,150 @@
+#include "dag.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include "wish.h"
+#include "utils.h"
+#include "jobs.h"
+
+#define DAG_MAX_DEPS 64
+
+typedef struct {
+    char *name;      // NULL marks an empty slot
+    size_t len;
+    uint64_t hash;
+    int node;        // DAG_NO_NODE if the line ran in the line-by-line mode (already done)
+} Label;
+
+static Label *labels = NULL;
+static size_t label_cap = 0;
+static size_t label_count = 0;
+
+static int enabled = -1; // -1 until read from WISH_DAG
+
+bool dag_enabled(void) {
+    if (enabled < 0) {
+        const char *env = getenv("WISH_DAG");
+        enabled = env && strcmp(env, "on") == 0;
+    }
+    return enabled;
+}
+
+void dag_set_enabled(bool on) {
+    enabled = on;
+}
+
+static Label *find_label(const char *name, size_t len, uint64_t h) {
+    size_t mask = label_cap - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        Label *l = &labels[i];
+        if (!l->name) return l;
+        if (l->hash == h && l->len == len && memcmp(l->name, name, len) == 0) return l;
+    }
+}
+
+static int grow_labels(void) {
+    size_t new_cap = label_cap ? label_cap * 2 : 64;
+    Label *new_labels = calloc(new_cap, sizeof(Label));
+    if (!new_labels) return -1;
+    Label *old = labels;
+    size_t old_cap = label_cap;
+    labels = new_labels;
+    label_cap = new_cap;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old[i].name) *find_label(old[i].name, old[i].len, old[i].hash) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+// Points the label at node; a later line may reuse a label
+static int define_label(const char *name, size_t len, int node) {
+    if ((label_count + 1) * 4 > label_cap * 3 && grow_labels() != 0) return -1;
+    uint64_t h = hash_bytes(name, len);
+    Label *l = find_label(name, len, h);
+    if (!l->name) {
+        l->name = malloc(len);
+        if (!l->name) return -1;
+        memcpy(l->name, name, len);
+        l->len = len;
+        l->hash = h;
+        label_count++;
+    }
+    l->node = node;
+    return 0;
+}
+
+static bool is_label_char(char c) {
+    return c != ':' && c != ',' && c != '[' && c != ']' && c != ' ' && c != '\t';
+}
+
+// Length of the label at p, which must be followed by one of the chars in stop
+static size_t label_length(const char *p, const char *end, const char *stop) {
+    size_t n = 0;
+    while (p + n < end && is_label_char(p[n])) n++;
+    return (n > 0 && p + n < end && strchr(stop, p[n])) ? n : 0;
+}
+
+int dag_begin_line(const char **line, size_t *len) {
+    const char *p = *line;
+    const char *end = p + *len;
+    // `[` followed by a blank is the test command, not an annotation
+    if (*len < 2 || p[0] != '[' || p[1] == ' ' || p[1] == '\t') return DAG_NO_NODE;
+    p++;
+
+    const char *name = p;
+    size_t name_len = 0;
+    if (*p != ':') {
+        name_len = label_length(p, end, ":]");
+        if (name_len == 0) goto malformed;
+        p += name_len;
+    }
+
+    int deps[DAG_MAX_DEPS];
+    int dep_count = 0;
+    if (*p == ':') {
+        do {
+            p++;
+            size_t n = label_length(p, end, ",]");
+            if (n == 0 || dep_count == DAG_MAX_DEPS) goto malformed;
+            Label *l = label_cap ? find_label(p, n, hash_bytes(p, n)) : NULL;
+            if (!l || !l->name) {
+                shell_error(ENOENT); // unknown label
+                return DAG_ERROR;
+            }
+            // Labels from the line-by-line mode have finished already
+            if (l->node >= 0) deps[dep_count++] = l->node;
+            p += n;
+        } while (*p == ',');
+    }
+    p++; // the closing ']'
+    if (p < end && *p != ' ' && *p != '\t') goto malformed;
+
+    int node = DAG_NO_NODE;
+    if (dag_enabled() && (name_len > 0 || dep_count > 0)) {
+        node = sched_node_open(deps, dep_count);
+        if (node < 0) {
+            shell_error(ENOMEM);
+            return DAG_ERROR;
+        }
+    }
+    if (name_len > 0 && define_label(name, name_len, node) != 0) {
+        if (node >= 0) sched_node_close(node);
+        shell_error(ENOMEM);
+        return DAG_ERROR;
+    }
+
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+    *len = end - p;
+    *line = p;
+    return node;
+
+malformed:
+    shell_error(EINVAL);
+    return DAG_ERROR;
+}
+
+void dag_end_line(int node) {
+    if (node >= 0) sched_node_close(node);
+}
@@ -0,0 +1,33 @@
+#ifndef DAG_H
+#define DAG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Concurrent batch mode. Lines are no longer waited for one at a time: each
+// line's jobs start as soon as a worker slot (`jobs -j`) is free, so
+// independent lines overlap. `wait` is a barrier for everything before it, and
+// a line may be labelled and depend on earlier labelled lines:
+//     [fetch] curl -o src.tgz ...
+//     [unpack:fetch] tar xf src.tgz
+//     [:fetch,unpack] ./check
+// The scheduler holds a line's jobs until the lines it depends on have
+// finished. In the normal line-by-line mode annotations are accepted and have
+// no effect. Enabled with `dag on` or WISH_DAG=on.
+
+bool dag_enabled(void);
+void dag_set_enabled(bool on);
+
+#define DAG_NO_NODE (-1)
+#define DAG_ERROR (-2)
+
+// Strips a leading annotation from the line view [*line, *line + *len) and, in
+// the concurrent mode, opens the line's scheduler node. Returns the node,
+// DAG_NO_NODE if the line needs none, or DAG_ERROR if the annotation is
+// malformed or names an unknown label (the error has been reported).
+int dag_begin_line(const char **line, size_t *len);
+
+// Closes the node returned by dag_begin_line once the line has been submitted
+void dag_end_line(int node);
+
+#endif // DAG_H
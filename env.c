@@ -0,0 +1,192 @@
+#include "env.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include "utils.h"
+
+#define SLOT_EMPTY (-1)
+#define SLOT_DELETED (-2)
+
+extern char **environ;
+
+static char **vars = NULL;   // "NAME=value", NULL-terminated; the envp
+static int var_count = 0;
+static int var_cap = 0;      // not counting the terminator
+
+static int *slots = NULL;    // name hash -> index into vars
+static size_t slot_cap = 0;
+static size_t slots_used = 0; // live and deleted slots
+static bool loaded = false;
+static unsigned long generation = 0;
+
+static size_t name_length(const char *entry) {
+    const char *eq = strchr(entry, '=');
+    return eq ? (size_t)(eq - entry) : strlen(entry);
+}
+
+/* ----------------- Map ----------------- */
+
+// The slot holding name, or the slot it would be inserted at
+static int *find_slot(const char *name, size_t len) {
+    size_t mask = slot_cap - 1;
+    int *insert_at = NULL;
+    for (size_t i = hash_bytes(name, len) & mask;; i = (i + 1) & mask) {
+        int v = slots[i];
+        if (v == SLOT_EMPTY) return insert_at ? insert_at : &slots[i];
+        if (v == SLOT_DELETED) {
+            if (!insert_at) insert_at = &slots[i];
+        } else if (name_length(vars[v]) == len && memcmp(vars[v], name, len) == 0) {
+            return &slots[i];
+        }
+    }
+}
+
+// Rebuilds the map sized for the current variables, dropping deleted slots
+static int rehash(void) {
+    size_t new_cap = 64;
+    while (new_cap < ((size_t)var_count + 1) * 2) new_cap *= 2;
+    int *new_slots = malloc(sizeof(int) * new_cap);
+    if (!new_slots) return -1;
+    memset(new_slots, 0xff, sizeof(int) * new_cap); // SLOT_EMPTY
+    free(slots);
+    slots = new_slots;
+    slot_cap = new_cap;
+    slots_used = var_count;
+    for (int i = 0; i < var_count; i++) *find_slot(vars[i], name_length(vars[i])) = i;
+    return 0;
+}
+
+// Adds or replaces the variable named by the first len bytes of entry
+static int store(const char *entry, size_t len) {
+    if ((slots_used + 1) * 4 > slot_cap * 3 && rehash() != 0) return -1;
+    if (var_count >= var_cap) {
+        int new_cap = var_cap ? var_cap * 2 : 64;
+        char **new_vars = realloc(vars, sizeof(char*) * (new_cap + 1));
+        if (!new_vars) return -1;
+        vars = new_vars;
+        var_cap = new_cap;
+    }
+    char *copy = strdup(entry);
+    if (!copy) return -1;
+    int *slot = find_slot(entry, len);
+    if (*slot >= 0) {
+        free(vars[*slot]);
+        vars[*slot] = copy;
+    } else {
+        if (*slot == SLOT_EMPTY) slots_used++;
+        *slot = var_count;
+        vars[var_count++] = copy;
+    }
+    vars[var_count] = NULL;
+    generation++;
+    return 0;
+}
+
+// Inherited names are kept even where export would refuse them
+static void load(void) {
+    if (loaded) return;
+    loaded = true;
+    // Allocated up front, so even an empty environment has a block
+    vars = malloc(sizeof(char*) * (64 + 1));
+    if (!vars) return;
+    vars[0] = NULL;
+    var_cap = 64;
+    for (char **e = environ; e && *e; e++) {
+        if (strchr(*e, '=')) store(*e, name_length(*e));
+    }
+    generation = 0; // still the environment the shell started with
+}
+
+/* ----------------- Public interface ----------------- */
+
+char *const *env_block(void) {
+    load();
+    // Only an allocation failure at load leaves no array
+    return vars ? vars : environ;
+}
+
+unsigned long env_generation(void) {
+    return generation;
+}
+
+bool env_valid_name(const char *name, size_t len) {
+    if (len == 0 || (name[0] >= '0' && name[0] <= '9')) return false;
+    for (size_t i = 0; i < len; i++) {
+        char c = name[i];
+        if (!(c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int env_put(const char *entry) {
+    load();
+    size_t len = name_length(entry);
+    if (!entry[len] || !env_valid_name(entry, len)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (store(entry, len) != 0) return -1;
+    // Keep getenv truthful for the shell's own settings
+    char *name = strndup(entry, len);
+    if (name) {
+        setenv(name, entry + len + 1, 1);
+        free(name);
+    }
+    return 0;
+}
+
+int env_unset(const char *name) {
+    load();
+    size_t len = strlen(name);
+    if (!env_valid_name(name, len)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (slot_cap == 0) return 0;
+    int *slot = find_slot(name, len);
+    if (*slot < 0) return 0;
+    int index = *slot;
+    *slot = SLOT_DELETED;
+    free(vars[index]);
+    // The last variable fills the hole, so the array stays dense
+    var_count--;
+    if (index != var_count) {
+        vars[index] = vars[var_count];
+        *find_slot(vars[index], name_length(vars[index])) = index;
+    }
+    vars[var_count] = NULL;
+    generation++;
+    unsetenv(name);
+    return 0;
+}
+
+const char *env_get(const char *name) {
+    load();
+    if (slot_cap == 0) return NULL;
+    size_t len = strlen(name);
+    int *slot = find_slot(name, len);
+    return *slot >= 0 ? vars[*slot] + len + 1 : NULL;
+}
+
+int env_replace(char *const *entries, int count) {
+    load();
+    for (int i = 0; i < var_count; i++) free(vars[i]);
+    var_count = 0;
+    if (vars) vars[0] = NULL;
+    if (slot_cap > 0) memset(slots, 0xff, sizeof(int) * slot_cap);
+    slots_used = 0;
+    generation++;
+    for (int i = 0; i < count; i++) {
+        if (strchr(entries[i], '=') && store(entries[i], name_length(entries[i])) != 0) return -1;
+    }
+    return 0;
+}
+
+void env_print(void) {
+    char *const *envp = env_block();
+    for (int i = 0; envp[i]; i++) printf("export %s\n", envp[i]);
+}
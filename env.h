@@ -0,0 +1,42 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// The environment passed to launched programs. Variables live in a hash map
+// indexed by name, whose values are the "NAME=value" strings of a
+// NULL-terminated array that is itself the envp handed to execve and
+// posix_spawn: `export` and `unset` update it in place, and a launch uses it
+// as is, without scanning or copying. Loaded from environ on first use; the
+// process environment (getenv) is kept in step.
+
+// envp for launching children
+char *const *env_block(void);
+
+// 0 while the environment is the one inherited at startup, then bumped by
+// every change, so copies elsewhere (the zygote's) know to refresh
+unsigned long env_generation(void);
+
+// True if name is a valid variable name ([A-Za-z_][A-Za-z0-9_]*)
+bool env_valid_name(const char *name, size_t len);
+
+// Sets a variable from a "NAME=value" string. Returns 0, or -1 with errno set
+// (EINVAL for a bad name).
+int env_put(const char *entry);
+
+// Removes a variable; unknown names are ignored. Returns 0, or -1 with errno set.
+int env_unset(const char *name);
+
+// Value of name, or NULL
+const char *env_get(const char *name);
+
+// Replaces every variable with entries ("NAME=value" strings, taken as they
+// are). Used by the zygote to adopt the shell's environment; getenv is not
+// updated. Returns 0, or -1 with errno set.
+int env_replace(char *const *entries, int count);
+
+// Prints the variables as `export NAME=value` lines
+void env_print(void);
+
+#endif // ENV_H
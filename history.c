@@ -0,0 +1,328 @@
+#define _GNU_SOURCE // For memmem
+#include "history.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "utils.h"
+
+#define HISTORY_MAGIC 0x31485357u // "WSH1", marks record starts
+#define HISTORY_MAX_LINE (1u << 20)
+
+// On disk each record is this header followed by len bytes of text
+typedef struct {
+    uint32_t magic;
+    uint32_t len;
+    uint64_t hash; // hash_bytes of the text, for de-duplication without reading it
+} RecordHeader;
+
+typedef struct {
+    const char *text; // in the mapping, or a malloc'd copy for lines added since
+    uint32_t len;
+    bool live;        // false once a later identical entry exists
+    bool owned;
+    uint64_t hash;
+} Entry;
+
+// Entry ids containing one trigram, ascending
+typedef struct {
+    uint32_t key; // trigram | TRIGRAM_USED, 0 for an empty slot
+    uint32_t count;
+    uint32_t cap;
+    uint32_t *ids;
+} Posting;
+
+#define TRIGRAM_USED (1u << 24)
+
+static int log_fd = -1;
+static const char *map = NULL;
+static size_t map_len = 0;
+static bool walked = false; // the mapping has been turned into entries
+
+static Entry *entries = NULL;
+static int entry_count = 0;
+static int entry_cap = 0;
+
+// hash -> newest entry id with that hash, open addressing
+static int *latest = NULL;
+static size_t latest_cap = 0;
+
+static Posting *postings = NULL;
+static size_t posting_cap = 0;
+static size_t posting_count = 0;
+static int indexed = 0; // entries [0, indexed) are in the trigram index
+
+/* ----------------- Entries ----------------- */
+
+static int *find_latest(uint64_t hash) {
+    size_t mask = latest_cap - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        if (latest[i] < 0 || entries[latest[i]].hash == hash) return &latest[i];
+    }
+}
+
+static int grow_latest(void) {
+    size_t new_cap = latest_cap ? latest_cap * 2 : 1024;
+    int *new_latest = malloc(sizeof(int) * new_cap);
+    if (!new_latest) return -1;
+    memset(new_latest, 0xff, sizeof(int) * new_cap); // -1: empty
+    int *old = latest;
+    size_t old_cap = latest_cap;
+    latest = new_latest;
+    latest_cap = new_cap;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old[i] >= 0) *find_latest(entries[old[i]].hash) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+// Appends an entry, superseding an earlier identical one
+static int push_entry(const char *text, uint32_t len, uint64_t hash, bool owned) {
+    if (entry_count >= entry_cap) {
+        int new_cap = entry_cap ? entry_cap * 2 : 1024;
+        Entry *new_entries = realloc(entries, sizeof(Entry) * new_cap);
+        if (!new_entries) return -1;
+        entries = new_entries;
+        entry_cap = new_cap;
+    }
+    if (((size_t)entry_count + 1) * 2 > latest_cap && grow_latest() != 0) return -1;
+    Entry *e = &entries[entry_count];
+    e->text = text;
+    e->len = len;
+    e->hash = hash;
+    e->live = true;
+    e->owned = owned;
+    // Hash collisions between different lines just keep both
+    int *slot = find_latest(hash);
+    if (*slot >= 0 && entries[*slot].len == len && memcmp(entries[*slot].text, text, len) == 0) {
+        entries[*slot].live = false;
+    }
+    *slot = entry_count++;
+    return 0;
+}
+
+// Turns the mapped log into entries, reading only the record headers. A torn
+// or foreign record is skipped up to the next record marker.
+static void walk_log(void) {
+    if (walked) return;
+    walked = true;
+    size_t off = 0;
+    while (off + sizeof(RecordHeader) <= map_len) {
+        RecordHeader h;
+        memcpy(&h, map + off, sizeof(h));
+        if (h.magic == HISTORY_MAGIC && h.len <= HISTORY_MAX_LINE &&
+            h.len <= map_len - off - sizeof(h)) {
+            if (push_entry(map + off + sizeof(h), h.len, h.hash, false) != 0) return;
+            off += sizeof(h) + h.len;
+            continue;
+        }
+        uint32_t magic = HISTORY_MAGIC;
+        const char *next = memmem(map + off + 1, map_len - off - 1, &magic, sizeof(magic));
+        if (!next) break;
+        off = (size_t)(next - map);
+    }
+}
+
+/* ----------------- Trigram index ----------------- */
+
+static uint32_t trigram_at(const char *p) {
+    return ((uint32_t)(unsigned char)p[0] << 16) | ((uint32_t)(unsigned char)p[1] << 8) |
+           (uint32_t)(unsigned char)p[2];
+}
+
+static Posting *find_posting(uint32_t trigram) {
+    if (posting_cap == 0) return NULL;
+    uint32_t key = trigram | TRIGRAM_USED;
+    size_t mask = posting_cap - 1;
+    for (size_t i = (key * 2654435761u) & mask;; i = (i + 1) & mask) {
+        if (postings[i].key == key || postings[i].key == 0) return &postings[i];
+    }
+}
+
+static int grow_postings(void) {
+    size_t new_cap = posting_cap ? posting_cap * 2 : 4096;
+    Posting *new_postings = calloc(new_cap, sizeof(Posting));
+    if (!new_postings) return -1;
+    Posting *old = postings;
+    size_t old_cap = posting_cap;
+    postings = new_postings;
+    posting_cap = new_cap;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old[i].key) *find_posting(old[i].key & ~TRIGRAM_USED) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+static int index_entry(int id) {
+    const Entry *e = &entries[id];
+    for (uint32_t i = 0; i + 3 <= e->len; i++) {
+        if ((posting_count + 1) * 2 > posting_cap && grow_postings() != 0) return -1;
+        Posting *p = find_posting(trigram_at(e->text + i));
+        if (!p->key) {
+            p->key = trigram_at(e->text + i) | TRIGRAM_USED;
+            posting_count++;
+        }
+        // Ids arrive in order, so a repeat within this entry is the last one
+        if (p->count > 0 && p->ids[p->count - 1] == (uint32_t)id) continue;
+        if (p->count >= p->cap) {
+            uint32_t new_cap = p->cap ? p->cap * 2 : 4;
+            uint32_t *new_ids = realloc(p->ids, sizeof(uint32_t) * new_cap);
+            if (!new_ids) return -1;
+            p->ids = new_ids;
+            p->cap = new_cap;
+        }
+        p->ids[p->count++] = (uint32_t)id;
+    }
+    return 0;
+}
+
+// Brings the index up to date. Returns false if it could not be built.
+static bool update_index(void) {
+    for (; indexed < entry_count; indexed++) {
+        if (entries[indexed].live && index_entry(indexed) != 0) return false;
+    }
+    return true;
+}
+
+/* ----------------- Public interface ----------------- */
+
+void history_close(void) {
+    for (int i = 0; i < entry_count; i++) {
+        if (entries[i].owned) free((char *)entries[i].text);
+    }
+    free(entries);
+    entries = NULL;
+    entry_count = entry_cap = 0;
+    free(latest);
+    latest = NULL;
+    latest_cap = 0;
+    for (size_t i = 0; i < posting_cap; i++) free(postings[i].ids);
+    free(postings);
+    postings = NULL;
+    posting_cap = posting_count = 0;
+    indexed = 0;
+    if (map) munmap((void *)map, map_len);
+    map = NULL;
+    map_len = 0;
+    walked = false;
+    if (log_fd >= 0) close(log_fd);
+    log_fd = -1;
+}
+
+int history_open(const char *path) {
+    history_close();
+    if (!path) return 0;
+    log_fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (log_fd < 0) return -1;
+    struct stat st;
+    if (fstat(log_fd, &st) != 0) return -1;
+    if (st.st_size > 0) {
+        void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, log_fd, 0);
+        if (p == MAP_FAILED) return -1;
+        map = p;
+        map_len = (size_t)st.st_size;
+    }
+    return 0;
+}
+
+void history_init_from_env(void) {
+    const char *path = getenv("WISH_HISTFILE");
+    char buf[4096];
+    if (!path) {
+        const char *home = getenv("HOME");
+        if (!home || !*home) return;
+        snprintf(buf, sizeof(buf), "%s/.wish_history", home);
+        path = buf;
+    }
+    // An empty WISH_HISTFILE keeps history for this session only
+    history_open(*path ? path : NULL);
+}
+
+int history_add(const char *line, size_t len) {
+    if (len == 0 || len > HISTORY_MAX_LINE) return 0;
+    walk_log();
+    char *copy = malloc(len);
+    if (!copy) return -1;
+    memcpy(copy, line, len);
+    uint64_t hash = hash_bytes(line, len);
+    if (push_entry(copy, (uint32_t)len, hash, true) != 0) {
+        free(copy);
+        return -1;
+    }
+    if (log_fd < 0) return 0;
+    // Header and text in one O_APPEND write, so concurrent shells cannot split it
+    RecordHeader h = { HISTORY_MAGIC, (uint32_t)len, hash };
+    char *record = malloc(sizeof(h) + len);
+    if (!record) return -1;
+    memcpy(record, &h, sizeof(h));
+    memcpy(record + sizeof(h), line, len);
+    ssize_t w = write(log_fd, record, sizeof(h) + len);
+    free(record);
+    if (w < 0) return -1;
+    return 0;
+}
+
+int history_count(void) {
+    walk_log();
+    return entry_count;
+}
+
+const char *history_entry(int id, size_t *len) {
+    walk_log();
+    if (id < 0 || id >= entry_count || !entries[id].live) return NULL;
+    *len = entries[id].len;
+    return entries[id].text;
+}
+
+int history_search(const char *needle, size_t len, int before) {
+    walk_log();
+    if (before > entry_count) before = entry_count;
+    if (len < 3 || !update_index()) {
+        for (int id = before - 1; id >= 0; id--) {
+            const Entry *e = &entries[id];
+            if (e->live && memmem(e->text, e->len, needle, len)) return id;
+        }
+        return -1;
+    }
+    // Only entries holding the needle's rarest trigram can match
+    const Posting *best = NULL;
+    for (size_t i = 0; i + 3 <= len; i++) {
+        const Posting *p = find_posting(trigram_at(needle + i));
+        if (!p || !p->key) return -1;
+        if (!best || p->count < best->count) best = p;
+    }
+    uint32_t lo = 0, hi = best->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (best->ids[mid] < (uint32_t)before) lo = mid + 1;
+        else hi = mid;
+    }
+    while (lo-- > 0) {
+        const Entry *e = &entries[best->ids[lo]];
+        if (e->live && memmem(e->text, e->len, needle, len)) return (int)best->ids[lo];
+    }
+    return -1;
+}
+
+void history_print(int count) {
+    walk_log();
+    int first = 0;
+    if (count >= 0) {
+        // Walk back over live entries only
+        first = entry_count;
+        for (int shown = 0; first > 0 && shown < count;) {
+            if (entries[--first].live) shown++;
+        }
+    }
+    for (int id = first; id < entry_count; id++) {
+        if (entries[id].live) printf("%5d  %.*s\n", id + 1, (int)entries[id].len, entries[id].text);
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stddef.h>
+
+// Command history kept in an append-only log ($WISH_HISTFILE, by default
+// ~/.wish_history). Each line is one length-prefixed record appended with a
+// single O_APPEND write, so shells sharing the file never interleave records.
+// The log is mmapped at startup and walked on first use; a trigram index for
+// reverse search is built the first time one runs. Repeated lines are kept
+// once: a new entry supersedes any earlier identical one.
+
+// Opens the history file named by the environment (memory only if there is none)
+void history_init_from_env(void);
+
+// Opens and maps path (NULL for a memory-only history), replacing any open
+// history. Returns 0, or -1 with errno set (the history is then memory only).
+int history_open(const char *path);
+
+void history_close(void);
+
+// Records a line and appends it to the file. Returns 0, or -1 with errno set.
+int history_add(const char *line, size_t len);
+
+// Entry ids run from 0 (oldest) to history_count() - 1 (newest)
+int history_count(void);
+
+// Text of entry id (not NUL-terminated), or NULL if a later identical entry
+// supersedes it
+const char *history_entry(int id, size_t *len);
+
+// Newest entry before id `before` that contains needle, or -1
+int history_search(const char *needle, size_t len, int before);
+
+// Prints the last count entries (all if count < 0) for the `history` builtin
+void history_print(int count);
+
+#endif // HISTORY_H
@@ -0,0 +1,361 @@
+#include "inproc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "pipe_io.h"
+#include "utils.h"
+
+typedef struct {
+    const char *name;
+    // Returns the exit status, or INPROC_DECLINED before writing anything
+    int (*run)(char *const argv[], int out_fd, int err_fd);
+    bool blocking; // may wait, so only runs in-process when nothing should overlap it
+} InprocUtility;
+
+static int enabled = -1; // -1 until read from WISH_INPROC
+static unsigned long saved_launches = 0;
+
+bool inproc_enabled(void) {
+    if (enabled < 0) {
+        const char *env = getenv("WISH_INPROC");
+        enabled = !(env && strcmp(env, "off") == 0);
+    }
+    return enabled;
+}
+
+void inproc_set_enabled(bool on) {
+    enabled = on;
+}
+
+unsigned long inproc_saved_launches(void) {
+    return saved_launches;
+}
+
+/* ----------------- Output buffer ----------------- */
+
+// echo and printf build their whole output first, so a declined command has
+// written nothing, and the output leaves in one write
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} OutBuf;
+
+static int out_append(OutBuf *out, const char *s, size_t n) {
+    if (out->len + n > out->cap) {
+        size_t new_cap = out->cap ? out->cap * 2 : 256;
+        while (new_cap < out->len + n) new_cap *= 2;
+        char *p = realloc(out->data, new_cap);
+        if (!p) return -1;
+        out->data = p;
+        out->cap = new_cap;
+    }
+    memcpy(out->data + out->len, s, n);
+    out->len += n;
+    return 0;
+}
+
+static int write_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += w;
+        n -= w;
+    }
+    return 0;
+}
+
+// Writes the buffer and frees it; returns the exit status
+static int out_finish(OutBuf *out, int out_fd) {
+    int status = write_all(out_fd, out->data, out->len) == 0 ? 0 : 1;
+    free(out->data);
+    return status;
+}
+
+// --help and --version alone make the real utilities print their own text
+static bool is_info_request(char *const argv[]) {
+    return argv[1] && !argv[2] && (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "--version") == 0);
+}
+
+/* ----------------- Utilities ----------------- */
+
+static int run_true(char *const argv[], int out_fd, int err_fd) {
+    (void)out_fd;
+    (void)err_fd;
+    return is_info_request(argv) ? INPROC_DECLINED : 0;
+}
+
+static int run_false(char *const argv[], int out_fd, int err_fd) {
+    (void)out_fd;
+    (void)err_fd;
+    return is_info_request(argv) ? INPROC_DECLINED : 1;
+}
+
+static int run_echo(char *const argv[], int out_fd, int err_fd) {
+    (void)err_fd;
+    if (is_info_request(argv)) return INPROC_DECLINED;
+    int i = 1;
+    bool newline = true;
+    // Leading words made only of option letters are options; -e needs escape handling
+    for (; argv[i] && argv[i][0] == '-' && argv[i][1]; i++) {
+        if (strspn(argv[i] + 1, "neE") != strlen(argv[i] + 1)) break;
+        if (strchr(argv[i], 'e')) return INPROC_DECLINED;
+        if (strchr(argv[i], 'n')) newline = false;
+    }
+    OutBuf out = { 0 };
+    for (int first = i; argv[i]; i++) {
+        if ((i > first && out_append(&out, " ", 1) != 0) ||
+            out_append(&out, argv[i], strlen(argv[i])) != 0) {
+            free(out.data);
+            return INPROC_DECLINED;
+        }
+    }
+    if (newline && out_append(&out, "\n", 1) != 0) {
+        free(out.data);
+        return INPROC_DECLINED;
+    }
+    return out_finish(&out, out_fd);
+}
+
+// Appends the escape sequence at *p (just past the backslash). Returns -1 for
+// sequences outside the supported set.
+static int append_escape(OutBuf *out, const char **p) {
+    static const char from[] = "\\abfnrtv\"";
+    static const char to[] = "\\\a\b\f\n\r\t\v\"";
+    const char *hit = **p ? strchr(from, **p) : NULL;
+    if (hit) {
+        (*p)++;
+        return out_append(out, &to[hit - from], 1);
+    }
+    if (**p >= '0' && **p <= '7') {
+        int value = 0;
+        for (int digits = 0; digits < 3 && **p >= '0' && **p <= '7'; digits++) {
+            value = value * 8 + (*(*p)++ - '0');
+        }
+        char c = (char)value;
+        return out_append(out, &c, 1);
+    }
+    return -1;
+}
+
+// Parses a printf integer argument the way the real printf accepts it; a
+// leading quote gives the character's code
+static int parse_integer(const char *arg, bool is_unsigned, long long *out) {
+    if (arg[0] == '\'' || arg[0] == '"') {
+        *out = (unsigned char)arg[1];
+        return 0;
+    }
+    char *end;
+    errno = 0;
+    *out = is_unsigned ? (long long)strtoull(arg, &end, 0) : strtoll(arg, &end, 0);
+    return (errno != 0 || end == arg || *end != '\0') ? -1 : 0;
+}
+
+// Formats one conversion at *p (just past the '%'). Returns -1 if unsupported.
+static int append_conversion(OutBuf *out, const char **p, char *const **args) {
+    char spec[32] = "%";
+    size_t n = 1;
+    const char *q = *p;
+    while (*q && strchr("-+ #0", *q) && n < 8) spec[n++] = *q++;
+    while (*q >= '0' && *q <= '9' && n < 16) spec[n++] = *q++;
+    if (*q == '.') {
+        spec[n++] = *q++;
+        while (*q >= '0' && *q <= '9' && n < 24) spec[n++] = *q++;
+    }
+    char conv = *q;
+    if (!conv || !strchr("sdiuxXoc", conv) || n >= 24) return -1;
+    *p = q + 1;
+
+    const char *arg = **args ? *(*args)++ : NULL;
+    char buf[512];
+    int len;
+    if (conv == 's' || conv == 'c') {
+        spec[n++] = conv;
+        spec[n] = '\0';
+        const char *s = arg ? arg : "";
+        if (conv == 'c') len = snprintf(buf, sizeof(buf), spec, s[0]);
+        else len = snprintf(buf, sizeof(buf), spec, s);
+        if (len < 0) return -1;
+        if ((size_t)len >= sizeof(buf)) {
+            // Long strings: only the plain %s form is worth handling without a bound
+            if (strcmp(spec, "%s") != 0) return -1;
+            return out_append(out, s, strlen(s));
+        }
+        return out_append(out, buf, len);
+    }
+    long long value = 0;
+    bool is_unsigned = conv != 'd' && conv != 'i';
+    if (arg && parse_integer(arg, is_unsigned, &value) != 0) return -1;
+    spec[n++] = 'l';
+    spec[n++] = 'l';
+    spec[n++] = conv;
+    spec[n] = '\0';
+    len = snprintf(buf, sizeof(buf), spec, value);
+    if (len < 0 || (size_t)len >= sizeof(buf)) return -1;
+    return out_append(out, buf, len);
+}
+
+static int run_printf(char *const argv[], int out_fd, int err_fd) {
+    (void)err_fd;
+    if (!argv[1] || is_info_request(argv) || (argv[1][0] == '-' && argv[1][1])) {
+        return INPROC_DECLINED;
+    }
+    const char *format = argv[1];
+    char *const *args = argv + 2;
+    OutBuf out = { 0 };
+    // The format is reused until every argument has been consumed
+    do {
+        char *const *before = args;
+        for (const char *p = format; *p;) {
+            int err;
+            if (*p == '\\') {
+                p++;
+                err = append_escape(&out, &p);
+            } else if (*p == '%' && p[1] == '%') {
+                p += 2;
+                err = out_append(&out, "%", 1);
+            } else if (*p == '%') {
+                p++;
+                err = append_conversion(&out, &p, &args);
+            } else {
+                const char *lit = p;
+                while (*p && *p != '\\' && *p != '%') p++;
+                err = out_append(&out, lit, p - lit);
+            }
+            if (err != 0) {
+                free(out.data);
+                return INPROC_DECLINED;
+            }
+        }
+        if (args == before) {
+            // No conversions: the real printf warns about ignored arguments
+            if (*args) {
+                free(out.data);
+                return INPROC_DECLINED;
+            }
+            break;
+        }
+    } while (*args);
+    return out_finish(&out, out_fd);
+}
+
+// Parses a sleep operand (seconds with an optional s/m/h/d suffix)
+static int parse_duration(const char *arg, double *seconds) {
+    char *end;
+    errno = 0;
+    double value = strtod(arg, &end);
+    if (errno != 0 || end == arg || value < 0 || value > 1e9) return -1;
+    switch (*end) {
+        case '\0': case 's': break;
+        case 'm': value *= 60; break;
+        case 'h': value *= 3600; break;
+        case 'd': value *= 86400; break;
+        default: return -1;
+    }
+    if (*end && end[1]) return -1;
+    *seconds = value;
+    return 0;
+}
+
+static int run_sleep(char *const argv[], int out_fd, int err_fd) {
+    (void)out_fd;
+    (void)err_fd;
+    if (!argv[1]) return INPROC_DECLINED;
+    double total = 0;
+    for (int i = 1; argv[i]; i++) {
+        double seconds;
+        if (parse_duration(argv[i], &seconds) != 0) return INPROC_DECLINED;
+        total += seconds;
+    }
+    struct timespec ts = { (time_t)total, (long)((total - (time_t)total) * 1e9) };
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {}
+    return 0;
+}
+
+static void report_file_error(int err_fd, const char *name, const char *message) {
+    char buf[512];
+    int len = snprintf(buf, sizeof(buf), "cat: %s: %s\n", name, message);
+    if (len > 0) write_all(err_fd, buf, (size_t)len < sizeof(buf) ? (size_t)len : sizeof(buf) - 1);
+}
+
+static int run_cat(char *const argv[], int out_fd, int err_fd) {
+    // Reading stdin or handling options is left to the real cat, and so are
+    // FIFOs and devices, whose open or read could block the shell
+    if (!argv[1]) return INPROC_DECLINED;
+    for (int i = 1; argv[i]; i++) {
+        struct stat st;
+        if (argv[i][0] == '-') return INPROC_DECLINED;
+        if (stat(argv[i], &st) == 0 && !S_ISREG(st.st_mode)) return INPROC_DECLINED;
+    }
+    struct stat out_st;
+    bool out_regular = fstat(out_fd, &out_st) == 0 && S_ISREG(out_st.st_mode);
+    int status = 0;
+    for (int i = 1; argv[i]; i++) {
+        int fd = open(argv[i], O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            report_file_error(err_fd, argv[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        struct stat in_st;
+        // Like the real cat, only complain when there is something left to copy into itself
+        if (out_regular && fstat(fd, &in_st) == 0 && in_st.st_size > 0 &&
+            in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino) {
+            report_file_error(err_fd, argv[i], "input file is output file");
+            status = 1;
+        } else if (splice_all(fd, out_fd) != 0) {
+            report_file_error(err_fd, argv[i], strerror(errno));
+            status = 1;
+        }
+        close(fd);
+    }
+    return status;
+}
+
+static const InprocUtility utilities[] = {
+    { "true", run_true, false },
+    { "false", run_false, false },
+    { "echo", run_echo, false },
+    { "printf", run_printf, false },
+    { "cat", run_cat, false },
+    { "sleep", run_sleep, true },
+    { NULL, NULL, false },
+};
+
+int inproc_run(const char *program, char *const argv[], const char *redir_target, bool may_block) {
+    if (!inproc_enabled()) return INPROC_DECLINED;
+    const char *base = strrchr(program, '/');
+    base = base ? base + 1 : program;
+    const InprocUtility *u = utilities;
+    while (u->name && strcmp(u->name, base) != 0) u++;
+    if (!u->name || (u->blocking && !may_block) || !is_system_program(program, u->name)) return INPROC_DECLINED;
+
+    int out_fd = STDOUT_FILENO;
+    int err_fd = STDERR_FILENO;
+    if (redir_target) {
+        // Opening a FIFO for writing waits for its reader, which may be a
+        // later command on this line, so those redirects go to a real child
+        struct stat st;
+        if (stat(redir_target, &st) == 0 && !S_ISREG(st.st_mode) && !S_ISCHR(st.st_mode)) {
+            return INPROC_DECLINED;
+        }
+        // Opened before the utility runs, as the child would; if it then declines,
+        // the exec truncates the same file again
+        out_fd = open(redir_target, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644);
+        if (out_fd < 0) return -1;
+        err_fd = out_fd;
+    }
+    fflush(stdout); // builtin output still in stdio's buffer goes first
+    int status = u->run(argv, out_fd, err_fd);
+    if (redir_target) close(out_fd);
+    if (status != INPROC_DECLINED) saved_launches++;
+    return status;
+}
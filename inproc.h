@@ -0,0 +1,33 @@
+#ifndef INPROC_H
+#define INPROC_H
+
+#include <stdbool.h>
+
+// In-process versions of trivial utilities (true, false, echo, printf, sleep,
+// cat FILE...). Batch files are full of these, and running them inside the
+// shell saves a whole fork+exec each. Output and `>` redirection behave like
+// the real programs; anything outside the supported subset (unknown options,
+// unsupported printf conversions, cat from stdin, a FIFO or a device) is
+// declined and exec'd.
+// Turned off with `inproc off` or WISH_INPROC=off for strict compatibility.
+
+#define INPROC_DECLINED (-2)
+
+bool inproc_enabled(void);
+void inproc_set_enabled(bool enabled);
+
+// Runs argv in the shell if an in-process utility covers it. program is the
+// executable the search path resolved; only the system's own copy of a
+// utility (in /bin or /usr/bin) is replaced, so a user's `echo` earlier on the
+// path still runs. Only a command alone on its line is offered, since the
+// commands of an `&` line must run in parallel. may_block allows utilities
+// that wait (sleep); the caller passes false when later lines should overlap
+// with it. Returns the exit status, INPROC_DECLINED if
+// the command must be exec'd instead, or -1 with errno set if the redirect
+// target could not be opened.
+int inproc_run(const char *program, char *const argv[], const char *redir_target, bool may_block);
+
+// Number of commands that ran in-process instead of being launched
+unsigned long inproc_saved_launches(void);
+
+#endif // INPROC_H
@@ -0,0 +1,543 @@
+#include "jobs.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "wish.h"
+#include "spawn.h"
+#include "reaper.h"
+#include "zygote.h"
+#include "pipe_io.h"
+#include "collate.h"
+#include "stats.h"
+#include "trace.h"
+#include "utils.h"
+
+// A queued pipeline (a plain command is a pipeline of one stage). The stage
+// tables, argv arrays and strings live in the same allocation as the struct,
+// so a job is freed with a single free().
+typedef struct Job {
+    struct Job *next;
+    int stage_count;
+    char **programs;      // resolved executable per stage
+    char ***argvs;        // NULL-terminated argv per stage
+    char *redir_target;   // applies to the last stage
+    bool splice_tail;     // last stage is a bare `cat` or `tee FILE`, replaced by an in-shell splice
+    pid_t *pids;          // running stages (0 once reaped)
+    int live;             // stages still running
+    SplicePump *pump;
+    Capture *capture;     // output collation slot, NULL when not collating
+    bool timed;           // `time` prefix: report usage when the job finishes
+    int report_fd;        // where the report goes, taken at submit; -1 for stderr
+    long long launched_ns;
+    long long user_ns;    // CPU time of the reaped stages
+    long long sys_ns;
+    long max_rss_kb;
+    int node;             // dependency node the job belongs to, -1 for none
+} Job;
+
+// A batch line in the concurrent batch mode (see sched_node_open)
+typedef struct {
+    int *deps;            // nodes that must complete before this node's jobs launch
+    int dep_count;
+    int live;             // jobs queued or running
+    bool closed;          // the line has submitted all of its jobs
+    int status;           // first failure among its jobs, 0 while none failed
+    int out_fd;           // where its jobs write, -1 for the shell's stdout/stderr
+    int err_fd;
+    int next_free;        // released nodes form a list for reuse
+} Node;
+
+static Node *nodes = NULL;
+static int node_count = 0;
+static int node_cap = 0;
+static int current_node = -1;    // node that new submissions join
+static int free_node = -1;       // most recently released node
+static bool node_completed = false; // set when a finished job completes its node
+
+static Job *queue_head = NULL;
+static Job *queue_tail = NULL;
+static int queued_count = 0;
+
+static Job *running_jobs = NULL;
+static int running_count = 0;
+
+static int max_jobs = -1; // -1 until initialised from the CPU count
+
+int sched_get_max_jobs(void) {
+    if (max_jobs < 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        max_jobs = cpus > 0 ? (int)cpus : 1;
+    }
+    return max_jobs;
+}
+
+void sched_set_max_jobs(int n) {
+    max_jobs = n < 0 ? 0 : n;
+}
+
+int sched_running_count(void) {
+    return running_count;
+}
+
+int sched_queued_count(void) {
+    return queued_count;
+}
+
+static size_t align_up(size_t n) {
+    return (n + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+}
+
+// At the end of a redirected pipeline, the system's `cat` with no arguments
+// and its `tee FILE` only copy bytes, so the shell can move them itself
+static bool is_splice_tail(const SchedStage *stage) {
+    char *const *argv = stage->argv;
+    if (!argv[1]) return is_system_program(stage->program, "cat");
+    return argv[1][0] != '-' && !argv[2] && is_system_program(stage->program, "tee");
+}
+
+static Job *job_create(const SchedStage *stages, int count, const char *redir_target) {
+    size_t pointers = 0, strings = 0;
+    for (int s = 0; s < count; s++) {
+        strings += strlen(stages[s].program) + 1;
+        int argc = 0;
+        while (stages[s].argv[argc]) strings += strlen(stages[s].argv[argc++]) + 1;
+        pointers += argc + 1;
+    }
+    if (redir_target) strings += strlen(redir_target) + 1;
+
+    size_t header = align_up(sizeof(Job));
+    size_t tables = align_up(sizeof(char*) * count + sizeof(char**) * count + sizeof(char*) * pointers);
+    size_t pid_table = align_up(sizeof(pid_t) * count);
+    Job *job = malloc(header + tables + pid_table + strings);
+    if (!job) return NULL;
+
+    char *base = (char *)job;
+    job->next = NULL;
+    job->stage_count = count;
+    job->programs = (char **)(base + header);
+    job->argvs = (char ***)(job->programs + count);
+    char **argv_slots = (char **)(job->argvs + count);
+    job->pids = (pid_t *)(base + header + tables);
+    char *p = base + header + tables + pid_table;
+
+    for (int s = 0; s < count; s++) {
+        job->programs[s] = p;
+        p = stpcpy(p, stages[s].program) + 1;
+        job->argvs[s] = argv_slots;
+        int argc = 0;
+        for (; stages[s].argv[argc]; argc++) {
+            argv_slots[argc] = p;
+            p = stpcpy(p, stages[s].argv[argc]) + 1;
+        }
+        argv_slots[argc] = NULL;
+        argv_slots += argc + 1;
+        job->pids[s] = 0;
+    }
+    job->redir_target = NULL;
+    if (redir_target) {
+        job->redir_target = p;
+        strcpy(p, redir_target);
+    }
+    job->splice_tail = count > 1 && redir_target && is_splice_tail(&stages[count - 1]);
+    job->live = 0;
+    job->pump = NULL;
+    job->capture = NULL;
+    job->timed = false;
+    job->report_fd = -1;
+    job->user_ns = 0;
+    job->sys_ns = 0;
+    job->max_rss_kb = 0;
+    job->node = -1;
+    return job;
+}
+
+static int slot_available(void) {
+    int limit = sched_get_max_jobs();
+    return limit == 0 || running_count < limit;
+}
+
+// Routes the pipeline's final pipe into the redirect file (and tee's file)
+// without a `cat` or `tee` process
+static void start_splice_tail(Job *job, int read_fd) {
+    int out_fd = open(job->redir_target, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644);
+    if (out_fd < 0) {
+        print_errno();
+        close(read_fd);
+        return;
+    }
+    const char *tee_file = job->argvs[job->stage_count - 1][1];
+    int copy_fd = -1;
+    if (tee_file) {
+        copy_fd = open(tee_file, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0666);
+        if (copy_fd < 0) print_errno(); // the output still goes through, as with tee
+    }
+    job->pump = copy_fd >= 0 ? tee_pump_start(read_fd, out_fd, copy_fd) : splice_pump_start(read_fd, out_fd);
+    if (!job->pump) {
+        // No thread available: drain synchronously, the producers are already running
+        if (copy_fd >= 0) tee_all(read_fd, out_fd, copy_fd);
+        else splice_all(read_fd, out_fd);
+        close(read_fd);
+        close(out_fd);
+        if (copy_fd >= 0) close(copy_fd);
+    }
+}
+
+// Starts one child, through the zygote when it is running
+static pid_t launch_stage(const char *program, char *const argv[], const char *redir_target,
+                          int stdin_fd, int stdout_fd, int stderr_fd) {
+    if (zygote_active()) {
+        pid_t pid = zygote_spawn(program, argv, redir_target, stdin_fd, stdout_fd, stderr_fd);
+        if (pid >= 0 || errno != ENOTCONN) return pid;
+    }
+    return spawn_command_fds(program, argv, redir_target, stdin_fd, stdout_fd, stderr_fd);
+}
+
+// Starts every stage of a pipeline at once, connected by pipes
+static void launch_job(Job *job) {
+    int stages = job->splice_tail ? job->stage_count - 1 : job->stage_count;
+    int prev_read = -1;
+    int capture_out = -1, capture_err = -1;
+    if (job->capture && collate_attach(job->capture, &capture_out, &capture_err) != 0) {
+        capture_out = capture_err = -1; // collation unavailable, write to the terminal directly
+    }
+    int stdout_fd = capture_out, stderr_fd = capture_err;
+    if (job->node >= 0 && nodes[job->node].out_fd >= 0) {
+        stdout_fd = nodes[job->node].out_fd;
+        stderr_fd = nodes[job->node].err_fd;
+    }
+    job->launched_ns = monotonic_now_ns();
+    for (int s = 0; s < stages; s++) {
+        int fds[2] = { -1, -1 };
+        bool last = s == stages - 1;
+        if ((!last || job->splice_tail) && make_pipe(fds) != 0) {
+            print_errno();
+            break;
+        }
+        const char *target = last && !job->splice_tail ? job->redir_target : NULL;
+        int out_fd = fds[1] >= 0 ? fds[1] : stdout_fd;
+        long long spawn_start = monotonic_now_ns();
+        pid_t pid = launch_stage(job->programs[s], job->argvs[s], target, prev_read, out_fd, stderr_fd);
+        if (pid > 0) stats_record_spawn(monotonic_now_ns() - spawn_start);
+        if (trace_active) {
+            trace_end(pid > 0 ? TRACE_SPAWN : TRACE_EXEC_FAILED, spawn_start, job->argvs[s][0]);
+        }
+        if (prev_read >= 0) close(prev_read);
+        if (fds[1] >= 0) close(fds[1]);
+        prev_read = fds[0];
+        if (pid < 0) {
+            print_errno();
+            if (job->node >= 0) sched_node_set_status(job->node, 127);
+            continue;
+        }
+        job->pids[s] = pid;
+        job->live++;
+    }
+    if (prev_read >= 0) {
+        if (job->splice_tail) start_splice_tail(job, prev_read);
+        else close(prev_read);
+    }
+    if (capture_out >= 0) {
+        close(capture_out);
+        close(capture_err);
+    }
+
+    // Children the reaper cannot watch are waited for here, now that every stage runs
+    for (int s = 0; s < stages; s++) {
+        if (job->pids[s] > 0 && reaper_watch(job->pids[s]) != 0) {
+            waitpid(job->pids[s], NULL, 0);
+            job->pids[s] = 0;
+            job->live--;
+        }
+    }
+}
+
+static long long timeval_ns(struct timeval tv) {
+    return (long long)tv.tv_sec * 1000000000LL + (long long)tv.tv_usec * 1000LL;
+}
+
+static bool node_complete(int node) {
+    return nodes[node].closed && nodes[node].live == 0;
+}
+
+// True if every node the job's node depends on has completed
+static bool job_ready(const Job *job) {
+    if (job->node < 0) return true;
+    const Node *n = &nodes[job->node];
+    for (int i = 0; i < n->dep_count; i++) {
+        if (!node_complete(n->deps[i])) return false;
+    }
+    return true;
+}
+
+static void finish_job(Job *job) {
+    if (job->node >= 0 && --nodes[job->node].live == 0 && nodes[job->node].closed) {
+        node_completed = true;
+        free(nodes[job->node].deps);
+        nodes[job->node].deps = NULL;
+        nodes[job->node].dep_count = 0;
+    }
+    splice_pump_join(job->pump);
+    if (job->capture) collate_close(job->capture);
+    if (job->timed) {
+        double real = (monotonic_now_ns() - job->launched_ns) / 1e9;
+        dprintf(job->report_fd >= 0 ? job->report_fd : STDERR_FILENO,
+                "real %.3fs user %.3fs sys %.3fs maxrss %ldKB\n",
+                real, job->user_ns / 1e9, job->sys_ns / 1e9, job->max_rss_kb);
+        if (job->report_fd >= 0) close(job->report_fd);
+    }
+    free(job);
+}
+
+// Launches queued jobs whose dependencies are met while slots are free. Jobs
+// still waiting on a node stay queued without holding up the ones behind them.
+static void launch_ready(void) {
+    do {
+        node_completed = false;
+        Job *prev = NULL;
+        Job **link = &queue_head;
+        while (*link && slot_available()) {
+            Job *job = *link;
+            if (!job_ready(job)) {
+                prev = job;
+                link = &job->next;
+                continue;
+            }
+            *link = job->next;
+            if (queue_tail == job) queue_tail = prev;
+            queued_count--;
+
+            launch_job(job);
+            if (job->live == 0) {
+                finish_job(job);
+                continue;
+            }
+            job->next = running_jobs;
+            running_jobs = job;
+            running_count++;
+        }
+        // A job that failed to start may have completed a node that jobs
+        // earlier in the queue are waiting for
+    } while (node_completed && slot_available());
+}
+
+static long long timespec_ns(struct timespec ts) {
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Records the child's lifetime on its own track, labelled with its exit status
+static void trace_reap(const char *name, const ReapedChild *child) {
+    char detail[64];
+    int code = WIFEXITED(child->status) ? WEXITSTATUS(child->status) : -1;
+    snprintf(detail, sizeof(detail), "%s (exit %d)", name, code);
+    trace_span(TRACE_REAP, timespec_ns(child->started), timespec_ns(child->exited), child->pid, detail);
+}
+
+// Marks the stage owning the reaped child as finished and accounts its usage;
+// the job frees its slot once every stage has exited
+static void release_stage(const ReapedChild *child) {
+    for (Job **link = &running_jobs; *link; link = &(*link)->next) {
+        Job *job = *link;
+        for (int s = 0; s < job->stage_count; s++) {
+            if (job->pids[s] != child->pid) continue;
+            job->pids[s] = 0;
+            // A pipeline's status is that of its last program
+            int last = job->splice_tail ? job->stage_count - 2 : job->stage_count - 1;
+            if (job->node >= 0 && s == last) {
+                int status = child->status;
+                sched_node_set_status(job->node, WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+            }
+            long long exited_ns = timespec_ns(child->exited);
+            stats_record_exit(job->argvs[s][0], exited_ns - job->launched_ns, &child->usage);
+            if (trace_active) trace_reap(job->argvs[s][0], child);
+            job->user_ns += timeval_ns(child->usage.ru_utime);
+            job->sys_ns += timeval_ns(child->usage.ru_stime);
+            if (child->usage.ru_maxrss > job->max_rss_kb) job->max_rss_kb = child->usage.ru_maxrss;
+            if (--job->live == 0) {
+                *link = job->next;
+                running_count--;
+                finish_job(job);
+            }
+            return;
+        }
+    }
+}
+
+// Blocks until the next running child exits (in completion order)
+static int reap_one(void) {
+    ReapedChild child;
+    int got;
+    do {
+        // Keep collated output flowing while we wait, or children could block on
+        // full pipes. A wakeup may turn out not to be an exit (the ring also
+        // completes reads and writes), so then go back to draining.
+        bool drained = !reaper_exit_pending() && collate_wait(reaper_fd());
+        got = reaper_wait(&child, drained ? 0 : -1);
+    } while (got == 0);
+    if (got != 1) {
+        // Nothing left to wait for; forget whatever we were tracking
+        while (running_jobs) {
+            Job *job = running_jobs;
+            running_jobs = job->next;
+            finish_job(job);
+        }
+        running_count = 0;
+        return -1;
+    }
+
+    release_stage(&child);
+    return 0;
+}
+
+static int enqueue(Job *job) {
+    if (queue_tail) queue_tail->next = job;
+    else queue_head = job;
+    queue_tail = job;
+    queued_count++;
+    launch_ready();
+    return 0;
+}
+
+int sched_submit_pipeline(const SchedStage *stages, int count, const char *redir_target, int flags) {
+    Job *job = job_create(stages, count, redir_target);
+    if (!job) {
+        errno = ENOMEM;
+        return -1;
+    }
+    job->timed = (flags & SCHED_TIMED) != 0;
+    job->node = current_node;
+    if (current_node >= 0) nodes[current_node].live++;
+    // Output slots are taken in submission order; redirected jobs write to
+    // their file and a node with its own output writes there
+    bool own_output = current_node >= 0 && nodes[current_node].out_fd >= 0;
+    if (collate_enabled() && !redir_target && !own_output) {
+        job->capture = collate_reserve();
+    }
+    // The node's stderr may be gone (or the shell's restored) by the time it finishes
+    if (job->timed && own_output) {
+        job->report_fd = fcntl(nodes[current_node].err_fd, F_DUPFD_CLOEXEC, 0);
+    }
+    return enqueue(job);
+}
+
+int sched_submit(const char *program, char *const argv[], const char *redir_target) {
+    SchedStage stage = { program, argv };
+    return sched_submit_pipeline(&stage, 1, redir_target, 0);
+}
+
+int sched_node_open(const int *deps, int dep_count) {
+    int index = free_node;
+    if (index >= 0) {
+        free_node = nodes[index].next_free;
+    } else if (node_count >= node_cap) {
+        int new_cap = node_cap ? node_cap * 2 : 64;
+        Node *new_nodes = realloc(nodes, sizeof(Node) * new_cap);
+        if (!new_nodes) return -1;
+        nodes = new_nodes;
+        node_cap = new_cap;
+    }
+    if (index < 0) index = node_count++;
+    Node *n = &nodes[index];
+    n->deps = NULL;
+    if (dep_count > 0) {
+        n->deps = malloc(sizeof(int) * dep_count);
+        if (!n->deps) {
+            n->next_free = free_node;
+            free_node = index;
+            return -1;
+        }
+        memcpy(n->deps, deps, sizeof(int) * dep_count);
+    }
+    n->dep_count = dep_count;
+    n->live = 0;
+    n->closed = false;
+    n->status = 0;
+    n->out_fd = -1;
+    n->err_fd = -1;
+    current_node = index;
+    return index;
+}
+
+void sched_node_close(int node) {
+    nodes[node].closed = true;
+    if (current_node == node) current_node = -1;
+    // Free the dependency list once nothing can wait on it any more
+    if (nodes[node].live == 0) {
+        free(nodes[node].deps);
+        nodes[node].deps = NULL;
+        nodes[node].dep_count = 0;
+    }
+}
+
+void sched_node_set_output(int node, int out_fd, int err_fd) {
+    nodes[node].out_fd = out_fd;
+    nodes[node].err_fd = err_fd;
+}
+
+void sched_node_set_status(int node, int status) {
+    if (node < 0) node = current_node;
+    if (node >= 0 && nodes[node].status == 0) nodes[node].status = status;
+}
+
+bool sched_node_done(int node) {
+    return node_complete(node);
+}
+
+int sched_node_status(int node) {
+    return nodes[node].status;
+}
+
+void sched_node_release(int node) {
+    nodes[node].next_free = free_node;
+    free_node = node;
+}
+
+void sched_poll(void) {
+    ReapedChild child;
+    while (running_count > 0 && reaper_wait(&child, 0) == 1) {
+        release_stage(&child);
+    }
+    launch_ready();
+}
+
+bool sched_current_node_ready(void) {
+    if (current_node < 0) return true;
+    Job probe = { .node = current_node };
+    return job_ready(&probe);
+}
+
+// True if a queued job could launch as soon as a slot frees up
+static bool ready_job_queued(void) {
+    for (Job *job = queue_head; job; job = job->next) {
+        if (job_ready(job)) return true;
+    }
+    return false;
+}
+
+void sched_wait_node_ready(void) {
+    launch_ready();
+    while (!sched_current_node_ready() && reap_one() == 0) {
+        launch_ready();
+    }
+}
+
+void sched_drain_queue(void) {
+    launch_ready();
+    // Jobs still waiting on a node stay queued: they launch once it completes
+    while (ready_job_queued() && reap_one() == 0) {
+        launch_ready();
+    }
+}
+
+void sched_wait_all(void) {
+    launch_ready();
+    while (running_count > 0) {
+        reap_one();
+        launch_ready();
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdbool.h>
+
+// Bounded-concurrency scheduler for the commands of a parallel (&) line.
+// Submitted commands are queued and launched while fewer than the maximum
+// number of jobs are running; each finished job frees a slot for the next.
+// A pipeline is one job: all of its stages start together and share a slot.
+
+// Maximum number of running children (0 means unlimited). Defaults to the
+// number of online CPUs.
+int sched_get_max_jobs(void);
+void sched_set_max_jobs(int max_jobs);
+
+// Queues a command (the arguments are copied) and launches it if a slot is free.
+// Returns 0 on success or -1 if the command could not be queued.
+int sched_submit(const char *program, char *const argv[], const char *redir_target);
+
+typedef struct {
+    const char *program;  // resolved executable
+    char *const *argv;
+} SchedStage;
+
+// Flags for sched_submit_pipeline
+#define SCHED_TIMED 0x1 // report real/user/sys time on the job's stderr when it finishes
+
+// Queues a pipeline: stage i's stdout feeds stage i+1's stdin, and redir_target
+// (if any) receives the last stage's output. The arguments are copied.
+int sched_submit_pipeline(const SchedStage *stages, int count, const char *redir_target, int flags);
+
+// Dependency nodes for the concurrent batch mode. A node stands for one batch
+// line: every job submitted while it is open belongs to it, and it completes
+// once it has been closed and all of its jobs have finished. Jobs of a node
+// stay queued until every node in deps has completed.
+// Returns the new node (now open), or -1 if memory ran out.
+int sched_node_open(const int *deps, int dep_count);
+void sched_node_close(int node);
+
+// Nodes of the command server (see server.h), one per client request. A node
+// with its own output has its jobs write to out_fd/err_fd instead of the
+// shell's stdout/stderr; the descriptors must stay open until it is done.
+void sched_node_set_output(int node, int out_fd, int err_fd);
+// Records status as the node's exit status unless a failure is recorded
+// already (node -1 is the open node, if any). Jobs record the status of their
+// last program, or 127 if it could not be started.
+void sched_node_set_status(int node, int status);
+bool sched_node_done(int node);
+int sched_node_status(int node);
+// Makes a done node's slot available to sched_node_open again
+void sched_node_release(int node);
+
+// Collects children that have exited and launches queued jobs, without blocking
+void sched_poll(void);
+
+// True unless the open node still waits for one of its dependencies
+bool sched_current_node_ready(void);
+
+// Blocks until the open node's dependencies have completed
+void sched_wait_node_ready(void);
+
+// Blocks until every queued command whose dependencies are met has been launched
+void sched_drain_queue(void);
+
+// Blocks until every queued command has been launched and reaped
+void sched_wait_all(void);
+
+int sched_running_count(void);
+int sched_queued_count(void);
+
+#endif // JOBS_H
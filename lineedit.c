@@ -0,0 +1,506 @@
+#define _GNU_SOURCE // For memmem and asprintf
+#include "lineedit.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "complete.h"
+#include "history.h"
+
+#define CTRL_KEY(c) ((c) & 0x1f)
+#define KEY_BACKSPACE 127
+#define KEY_ESC 27
+#define LIST_ASK_THRESHOLD 100 // ask before listing more candidates than this
+
+typedef struct {
+    char *buf;        // the line, NUL-terminated
+    size_t len;
+    size_t cap;
+    size_t pos;       // cursor, as a byte offset into buf
+    const char *prompt;
+    size_t prompt_len;
+    int history_pos;  // entry shown by Up/Down, history_count() for the new line
+    char *saved;      // the new line while browsing history
+    size_t saved_len;
+} Editor;
+
+static struct termios saved_termios;
+static bool raw_mode = false;
+static bool restore_registered = false;
+static bool at_eof = false;
+
+bool lineedit_available(int in_fd, int out_fd) {
+    const char *env = getenv("WISH_LINEEDIT");
+    if (env && strcmp(env, "off") == 0) return false;
+    const char *term = getenv("TERM");
+    if (term && strcmp(term, "dumb") == 0) return false;
+    return isatty(in_fd) && isatty(out_fd);
+}
+
+bool lineedit_at_eof(void) {
+    return at_eof;
+}
+
+/* ----------------- Terminal ----------------- */
+
+static void disable_raw(void) {
+    if (raw_mode) {
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &saved_termios);
+        raw_mode = false;
+    }
+}
+
+static int enable_raw(void) {
+    if (tcgetattr(STDIN_FILENO, &saved_termios) != 0) return -1;
+    if (!restore_registered) {
+        atexit(disable_raw);
+        restore_registered = true;
+    }
+    struct termios raw = saved_termios;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_cflag |= CS8;
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG); // Ctrl-C arrives as a key
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSADRAIN, &raw) != 0) return -1;
+    raw_mode = true;
+    return 0;
+}
+
+static size_t columns(void) {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0 || ws.ws_col == 0) return 80;
+    return ws.ws_col;
+}
+
+static void write_all(const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(STDOUT_FILENO, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        p += w;
+        n -= (size_t)w;
+    }
+}
+
+static void write_str(const char *s) {
+    write_all(s, strlen(s));
+}
+
+// Redraws prompt and line in one write, scrolled so the cursor stays visible
+static void refresh(const Editor *e) {
+    size_t cols = columns();
+    const char *text = e->buf;
+    size_t len = e->len;
+    size_t pos = e->pos;
+    while (e->prompt_len + pos >= cols && pos > 0) {
+        text++;
+        len--;
+        pos--;
+    }
+    if (e->prompt_len + len > cols) len = cols > e->prompt_len ? cols - e->prompt_len : 0;
+
+    char *out = malloc(e->prompt_len + len + 32);
+    if (!out) return;
+    size_t n = 0;
+    out[n++] = '\r';
+    memcpy(out + n, e->prompt, e->prompt_len);
+    n += e->prompt_len;
+    memcpy(out + n, text, len);
+    n += len;
+    // Clear the rest of the row, then put the cursor back in place
+    n += (size_t)sprintf(out + n, "\x1b[0K\r");
+    if (e->prompt_len + pos > 0) n += (size_t)sprintf(out + n, "\x1b[%zuC", e->prompt_len + pos);
+    write_all(out, n);
+    free(out);
+}
+
+/* ----------------- Editing ----------------- */
+
+static int ensure_capacity(Editor *e, size_t extra) {
+    if (e->len + extra + 1 <= e->cap) return 0;
+    size_t new_cap = e->cap ? e->cap * 2 : 128;
+    while (new_cap < e->len + extra + 1) new_cap *= 2;
+    char *new_buf = realloc(e->buf, new_cap);
+    if (!new_buf) return -1;
+    e->buf = new_buf;
+    e->cap = new_cap;
+    return 0;
+}
+
+static void insert_text(Editor *e, const char *s, size_t n) {
+    if (n == 0 || ensure_capacity(e, n) != 0) return;
+    memmove(e->buf + e->pos + n, e->buf + e->pos, e->len - e->pos + 1);
+    memcpy(e->buf + e->pos, s, n);
+    e->pos += n;
+    e->len += n;
+}
+
+// Removes [from, to) and leaves the cursor at from
+static void delete_range(Editor *e, size_t from, size_t to) {
+    if (from >= to) return;
+    memmove(e->buf + from, e->buf + to, e->len - to + 1);
+    e->len -= to - from;
+    e->pos = from;
+}
+
+static void set_line(Editor *e, const char *text, size_t len) {
+    e->len = e->pos = 0;
+    e->buf[0] = '\0';
+    insert_text(e, text, len);
+}
+
+static void free_editor(Editor *e) {
+    free(e->buf);
+    free(e->saved);
+}
+
+static size_t previous_word_start(const Editor *e) {
+    size_t p = e->pos;
+    while (p > 0 && e->buf[p - 1] == ' ') p--;
+    while (p > 0 && e->buf[p - 1] != ' ') p--;
+    return p;
+}
+
+/* ----------------- Completion ----------------- */
+
+// File candidates are shown without their directory part
+static const char *display_name(const Completions *c, const char *item) {
+    if (c->is_command) return item;
+    const char *name = item;
+    for (const char *p = item; p[0] && p[1]; p++) {
+        if (*p == '/') name = p + 1;
+    }
+    return name;
+}
+
+// Prints the candidates in columns below the line, in one write
+static void list_candidates(const Completions *c) {
+    size_t width = 0;
+    for (int i = 0; i < c->count; i++) {
+        size_t len = strlen(display_name(c, c->items[i]));
+        if (len > width) width = len;
+    }
+    width += 2;
+    size_t per_row = columns() / width;
+    if (per_row == 0) per_row = 1;
+
+    char *out = malloc((size_t)c->count * (width + 2) + 4);
+    if (!out) return;
+    size_t n = 0;
+    out[n++] = '\r';
+    out[n++] = '\n';
+    for (int i = 0; i < c->count; i++) {
+        const char *name = display_name(c, c->items[i]);
+        size_t len = strlen(name);
+        memcpy(out + n, name, len);
+        n += len;
+        if ((size_t)(i + 1) % per_row == 0 || i + 1 == c->count) {
+            out[n++] = '\r';
+            out[n++] = '\n';
+        } else {
+            memset(out + n, ' ', width - len);
+            n += width - len;
+        }
+    }
+    write_all(out, n);
+    free(out);
+}
+
+// Asks before listing a long set of candidates. Returns true to list them.
+static bool confirm_listing(int count) {
+    char question[80];
+    snprintf(question, sizeof(question), "\r\nDisplay all %d possibilities? (y or n)", count);
+    write_str(question);
+    char key = 'n';
+    while (read(STDIN_FILENO, &key, 1) < 0 && errno == EINTR) {}
+    if (key == 'y' || key == 'Y') return true;
+    write_str("\r\n");
+    return false;
+}
+
+static void complete_word(Editor *e, bool repeated) {
+    Completions c;
+    if (complete_line(e->buf, e->pos, &c) != 0 || c.count == 0) {
+        completions_free(&c);
+        write_str("\a");
+        return;
+    }
+    size_t word_len = e->pos - c.word_start;
+    size_t common = strlen(c.items[0]);
+    for (int i = 1; i < c.count; i++) {
+        size_t k = 0;
+        while (k < common && c.items[i][k] == c.items[0][k]) k++;
+        common = k;
+    }
+    const char *only = c.count == 1 ? c.items[0] : NULL;
+    if (common > word_len) {
+        insert_text(e, c.items[0] + word_len, common - word_len);
+    }
+    if (only) {
+        // A finished name is followed by a space; a directory stays open
+        size_t len = strlen(only);
+        if (only[len - 1] != '/' && (e->pos == e->len || e->buf[e->pos] != ' ')) insert_text(e, " ", 1);
+    } else if (common == word_len) {
+        if (!repeated) {
+            write_str("\a");
+        } else if (c.count <= LIST_ASK_THRESHOLD || confirm_listing(c.count)) {
+            list_candidates(&c);
+        }
+    }
+    completions_free(&c);
+}
+
+/* ----------------- History ----------------- */
+
+// Moves to the previous (step -1) or next (step 1) live history entry. Going
+// past the newest entry brings back the line being typed.
+static void browse_history(Editor *e, int step) {
+    int count = history_count();
+    int id = e->history_pos + step;
+    size_t len = 0;
+    const char *text = NULL;
+    while (id >= 0 && id < count && !(text = history_entry(id, &len))) id += step;
+    if (id < 0 || (id >= count && e->history_pos >= count)) {
+        write_str("\a");
+        return;
+    }
+    if (e->history_pos >= count) {
+        free(e->saved);
+        e->saved = malloc(e->len + 1);
+        if (!e->saved) return;
+        memcpy(e->saved, e->buf, e->len);
+        e->saved_len = e->len;
+    }
+    if (id >= count) {
+        id = count;
+        text = e->saved;
+        len = e->saved_len;
+    }
+    e->history_pos = id;
+    set_line(e, text, len);
+}
+
+// Shows the entry a search found, with the cursor on the matched text
+static void show_match(Editor *e, int id, const Editor *query) {
+    size_t len;
+    const char *text = history_entry(id, &len);
+    if (!text) return;
+    set_line(e, text, len);
+    const char *at = memmem(text, len, query->buf, query->len);
+    e->pos = at ? (size_t)(at - text) : 0;
+    e->history_pos = id;
+}
+
+// Runs a Ctrl-R incremental search, showing the newest entry that contains
+// the query. Ctrl-R again finds an older one and Ctrl-G gives up. Any other
+// key accepts the match and is returned for the caller to handle (so Enter
+// runs it); 0 means the key was used up here.
+static int reverse_search(Editor *e) {
+    Editor query = { NULL, 0, 0, 0, NULL, 0, 0, NULL, 0 };
+    char *original = malloc(e->len + 1);
+    if (!original || ensure_capacity(&query, 0) != 0) {
+        free(original);
+        return 0;
+    }
+    memcpy(original, e->buf, e->len);
+    size_t original_len = e->len, original_pos = e->pos;
+    int original_history_pos = e->history_pos;
+    query.buf[0] = '\0';
+    const char *prompt = e->prompt;
+    size_t prompt_len = e->prompt_len;
+    char *search_prompt = NULL;
+    int match = -1;
+    int result = 0;
+    bool failed = false;
+    while (1) {
+        free(search_prompt);
+        if (asprintf(&search_prompt, "(%sreverse-i-search)`%s': ", failed ? "failed " : "", query.buf) < 0) {
+            search_prompt = NULL;
+            break;
+        }
+        e->prompt = search_prompt;
+        e->prompt_len = strlen(search_prompt);
+        refresh(e);
+
+        char c;
+        ssize_t n = read(STDIN_FILENO, &c, 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        int key = (unsigned char)c;
+        int found;
+        if (key == CTRL_KEY('r')) {
+            if (query.len == 0) continue;
+            found = history_search(query.buf, query.len, match >= 0 ? match : history_count());
+        } else if (key == KEY_BACKSPACE || key == CTRL_KEY('h')) {
+            if (query.len > 0) query.buf[--query.len] = '\0';
+            query.pos = query.len;
+            found = query.len ? history_search(query.buf, query.len, history_count()) : -1;
+            if (query.len == 0) {
+                set_line(e, original, original_len);
+                match = -1;
+            }
+        } else if (key == CTRL_KEY('g')) {
+            set_line(e, original, original_len);
+            e->pos = original_pos;
+            e->history_pos = original_history_pos;
+            break;
+        } else if (key >= 32 && key != KEY_BACKSPACE) {
+            insert_text(&query, &c, 1);
+            // The current match stays if it still fits the longer query
+            found = history_search(query.buf, query.len, match >= 0 ? match + 1 : history_count());
+        } else {
+            result = key;
+            break;
+        }
+        failed = query.len > 0 && found < 0;
+        if (found >= 0) {
+            match = found;
+            show_match(e, match, &query);
+        } else if (failed) {
+            write_str("\a");
+        }
+    }
+    e->prompt = prompt;
+    e->prompt_len = prompt_len;
+    free(search_prompt);
+    free(query.buf);
+    free(original);
+    return result;
+}
+
+/* ----------------- Reading ----------------- */
+
+// Reads the rest of an escape sequence. Returns the final byte, with '~'
+// sequences mapped to 'H' (Home), 'F' (End) and 'D' + 0x80 (Delete).
+static int read_escape(void) {
+    char seq[3];
+    if (read(STDIN_FILENO, &seq[0], 1) != 1 || read(STDIN_FILENO, &seq[1], 1) != 1) return 0;
+    if (seq[0] == 'O') return seq[1];
+    if (seq[0] != '[') return 0;
+    if (seq[1] >= '0' && seq[1] <= '9') {
+        if (read(STDIN_FILENO, &seq[2], 1) != 1 || seq[2] != '~') return 0;
+        switch (seq[1]) {
+            case '1': case '7': return 'H';
+            case '4': case '8': return 'F';
+            case '3': return 'D' | 0x80;
+            default: return 0;
+        }
+    }
+    return seq[1];
+}
+
+// Copies the finished line out, getline style
+static ssize_t finish(Editor *e, char **line, size_t *cap) {
+    if (*cap < e->len + 2) {
+        char *new_line = realloc(*line, e->len + 2);
+        if (!new_line) {
+            free_editor(e);
+            return -1;
+        }
+        *line = new_line;
+        *cap = e->len + 2;
+    }
+    memcpy(*line, e->buf, e->len);
+    (*line)[e->len] = '\n';
+    (*line)[e->len + 1] = '\0';
+    ssize_t n = (ssize_t)e->len + 1;
+    free_editor(e);
+    return n;
+}
+
+ssize_t lineedit_read(const char *prompt, char **line, size_t *cap) {
+    Editor e = { NULL, 0, 0, 0, prompt, strlen(prompt), history_count(), NULL, 0 };
+    if (ensure_capacity(&e, 0) != 0) return -1;
+    e.buf[0] = '\0';
+    if (enable_raw() != 0) {
+        free(e.buf);
+        return -1;
+    }
+    refresh(&e);
+    int last_key = 0;
+    while (1) {
+        char c;
+        ssize_t n = read(STDIN_FILENO, &c, 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            disable_raw();
+            at_eof = n == 0;
+            free_editor(&e);
+            return -1;
+        }
+        int key = (unsigned char)c;
+        if (key == CTRL_KEY('r')) {
+            key = reverse_search(&e);
+            if (key == 0) {
+                refresh(&e);
+                continue;
+            }
+            c = (char)key;
+        }
+        switch (key) {
+            case '\r':
+            case '\n':
+                e.pos = e.len;
+                refresh(&e);
+                write_str("\r\n");
+                disable_raw();
+                return finish(&e, line, cap);
+            case CTRL_KEY('c'):
+                write_str("^C\r\n");
+                set_line(&e, "", 0);
+                e.history_pos = history_count();
+                break;
+            case CTRL_KEY('d'):
+                if (e.len == 0) {
+                    write_str("\r\n");
+                    disable_raw();
+                    at_eof = true;
+                    free_editor(&e);
+                    return -1;
+                }
+                if (e.pos < e.len) delete_range(&e, e.pos, e.pos + 1);
+                break;
+            case KEY_BACKSPACE:
+            case CTRL_KEY('h'):
+                if (e.pos > 0) delete_range(&e, e.pos - 1, e.pos);
+                break;
+            case '\t':
+                complete_word(&e, last_key == '\t');
+                break;
+            case CTRL_KEY('a'): e.pos = 0; break;
+            case CTRL_KEY('e'): e.pos = e.len; break;
+            case CTRL_KEY('b'): if (e.pos > 0) e.pos--; break;
+            case CTRL_KEY('f'): if (e.pos < e.len) e.pos++; break;
+            case CTRL_KEY('k'): e.len = e.pos; e.buf[e.len] = '\0'; break;
+            case CTRL_KEY('u'): delete_range(&e, 0, e.pos); break;
+            case CTRL_KEY('w'): delete_range(&e, previous_word_start(&e), e.pos); break;
+            case CTRL_KEY('l'): write_str("\x1b[H\x1b[2J"); break;
+            case CTRL_KEY('p'): browse_history(&e, -1); break;
+            case CTRL_KEY('n'): browse_history(&e, 1); break;
+            case KEY_ESC:
+                switch (read_escape()) {
+                    case 'A': browse_history(&e, -1); break;
+                    case 'B': browse_history(&e, 1); break;
+                    case 'C': if (e.pos < e.len) e.pos++; break;
+                    case 'D': if (e.pos > 0) e.pos--; break;
+                    case 'H': e.pos = 0; break;
+                    case 'F': e.pos = e.len; break;
+                    case 'D' | 0x80: if (e.pos < e.len) delete_range(&e, e.pos, e.pos + 1); break;
+                    default: break;
+                }
+                break;
+            default:
+                // Other control keys are ignored; bytes of UTF-8 sequences are kept
+                if (key >= 32) insert_text(&e, &c, 1);
+                break;
+        }
+        last_key = key;
+        refresh(&e);
+    }
+}
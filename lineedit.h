@@ -0,0 +1,25 @@
+#ifndef LINEEDIT_H
+#define LINEEDIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// Line editor for interactive use on a terminal. Reads in raw mode with cursor
+// movement, the usual Emacs-style keys (Ctrl-A/E/B/F/K/U/W/L, arrows, Home,
+// End, Delete) and Tab completion (see complete.h): a second Tab lists the
+// candidates. The terminal is back in its normal mode whenever commands run.
+
+// True if in_fd and out_fd are terminals the editor can drive and
+// WISH_LINEEDIT is not "off"
+bool lineedit_available(int in_fd, int out_fd);
+
+// Shows prompt and reads one edited line from stdin. Like getline, the line
+// ends in '\n'. Returns its length, or -1 at end of input (Ctrl-D on an empty
+// line) or on a read error.
+ssize_t lineedit_read(const char *prompt, char **line, size_t *cap);
+
+// True once lineedit_read has returned -1 because the input ended
+bool lineedit_at_eof(void);
+
+#endif // LINEEDIT_H
@@ -0,0 +1,103 @@
+#include "linescan.h"
+#include <ctype.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LINESCAN_X86 1
+#endif
+
+static const char *scan_line_scalar(const char *p, const char *end) {
+    while (p < end && *p != '\n') p++;
+    return p;
+}
+
+#ifdef LINESCAN_X86
+
+static const char *scan_line_sse2(const char *p, const char *end) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+        uint32_t nl_mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, nl));
+        if (nl_mask) return p + __builtin_ctz(nl_mask);
+        p += 16;
+    }
+    return scan_line_scalar(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char *scan_line_avx2(const char *p, const char *end) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)p);
+        uint32_t nl_mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, nl));
+        if (nl_mask) return p + __builtin_ctz(nl_mask);
+        p += 32;
+    }
+    return scan_line_sse2(p, end);
+}
+
+#endif // LINESCAN_X86
+
+typedef const char *(*ScanFn)(const char *, const char *);
+
+static ScanFn pick_scanner(void) {
+#ifdef LINESCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return scan_line_avx2;
+    if (__builtin_cpu_supports("sse2")) return scan_line_sse2;
+#endif
+    return scan_line_scalar;
+}
+
+const char *scan_line(const char *p, const char *end) {
+    static ScanFn scanner = NULL;
+    if (!scanner) scanner = pick_scanner();
+    return scanner(p, end);
+}
+
+int mapped_input_open(MappedInput *in, int fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) return -1;
+    in->size = (size_t)st.st_size;
+    if (in->size == 0) {
+        in->data = NULL;
+        in->cursor = NULL;
+        return 0;
+    }
+    void *map = mmap(NULL, in->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) return -1;
+    madvise(map, in->size, MADV_SEQUENTIAL);
+    in->data = map;
+    in->cursor = map;
+    return 0;
+}
+
+const char *mapped_input_next(MappedInput *in, size_t *len) {
+    const char *end = in->data + in->size;
+    if (!in->cursor || in->cursor >= end) return NULL;
+    const char *line = in->cursor;
+    const char *nl = scan_line(line, end);
+    *len = (size_t)(nl - line);
+    in->cursor = nl < end ? nl + 1 : end;
+    return line;
+}
+
+void mapped_input_close(MappedInput *in) {
+    if (in->data) munmap((void *)in->data, in->size);
+    in->data = NULL;
+    in->cursor = NULL;
+}
+
+const char *trim_view(const char *p, size_t *len) {
+    size_t n = *len;
+    while (n > 0 && isspace((unsigned char)*p)) {
+        p++;
+        n--;
+    }
+    while (n > 0 && isspace((unsigned char)p[n - 1])) n--;
+    *len = n;
+    return p;
+}
@@ -0,0 +1,30 @@
+#ifndef LINESCAN_H
+#define LINESCAN_H
+
+#include <stddef.h>
+
+// Finds the end of the line starting at p (the first '\n', or end if none).
+// Uses AVX2 or SSE2 when available, with a scalar fallback.
+const char *scan_line(const char *p, const char *end);
+
+// A read-only view of a batch file mapped into memory
+typedef struct {
+    const char *data;
+    size_t size;
+    const char *cursor;
+} MappedInput;
+
+// Maps a regular file. Returns 0, or -1 if it cannot be mapped (e.g. a pipe),
+// in which case the caller should fall back to stdio.
+int mapped_input_open(MappedInput *in, int fd);
+
+// Returns the next line (without its '\n') as a view, or NULL at end of input
+const char *mapped_input_next(MappedInput *in, size_t *len);
+
+void mapped_input_close(MappedInput *in);
+
+// Trims whitespace (including a trailing '\r') from both ends of the view
+// [p, p + *len). Returns the new start and updates *len.
+const char *trim_view(const char *p, size_t *len);
+
+#endif // LINESCAN_H
@@ -4,6 +4,7 @@
 #include <sys/wait.h>
 #include <string.h>
 #include "parallel.h"
+#include "spawn.h"
 
 //The one and only error message.
 char error_msg[30] = "An error has occurred.\n";
@@ -14,52 +15,68 @@ void run_parallel_cmds(char* cmds[]) {
     int n = 0;
     while (cmds[n] != NULL) n++;
 
-    //Store child process IDs here.
-    pid_t pids[n];
+    //Store child process IDs here. On the heap, since lines can be very wide.
+    pid_t* pids = calloc(n, sizeof(pid_t));
+    if (n > 0 && pids == NULL) {
+        write(STDERR_FILENO, error_msg, strlen(error_msg));
+        return;
+    }
 
     for (int i = 0; i < n; i++) {
 	//Check for empty commands. Terminate the whole thing if so.
         if (cmds[i] == NULL || strlen(cmds[i]) == 0) {
             write(STDERR_FILENO, error_msg, strlen(error_msg));
-            return;
+            break;
         }
-	//New process.
-        pids[i] = fork();
-
-	//Well, that's one failure of a fork if I say so myself.
-        if (pids[i] < 0) {
-            write(STDERR_FILENO, error_msg, strlen(error_msg));
-        } else if (pids[i] == 0) {
-            //Child process
-            char* args[10]; //Command limit is 10 so you can't crash the computer. :)
-            int argc = 0;
+        //Split the command into arguments, growing the list as needed.
+        int cap = 8;
+        char** args = malloc(sizeof(char*) * cap);
+        int argc = 0;
 
-            char* token = strtok(cmds[i], " ");
-            //Find spaces within commands.
-            while (token != NULL && argc < 9) {
-                args[argc++] = token;
-                token = strtok(NULL, " ");
+        char* token = args ? strtok(cmds[i], " ") : NULL;
+        //Find spaces within commands.
+        while (token != NULL) {
+            //Keep a slot free for the NULL at the end.
+            if (argc + 1 >= cap) {
+                char** bigger = realloc(args, sizeof(char*) * cap * 2);
+                if (bigger == NULL) break;
+                args = bigger;
+                cap *= 2;
             }
-	    //Set to null so execv works well.
-            args[argc] = NULL;
-
-            //Try /bin/ first
-            char path[256];
+            args[argc++] = token;
+            token = strtok(NULL, " ");
+        }
+        if (args == NULL || token != NULL || argc == 0) {
+            write(STDERR_FILENO, error_msg, strlen(error_msg));
+            free(args);
+            continue;
+        }
+        //Set to null so execv works well.
+        args[argc] = NULL;
 
-	    //Time to execute!
-            snprintf(path, sizeof(path), "/bin/%s", args[0]);
-            execv(path, args);
+        //Try /bin/ first
+        char* path = malloc(strlen("/bin/") + strlen(args[0]) + 1);
+        if (path == NULL) {
+            write(STDERR_FILENO, error_msg, strlen(error_msg));
+            free(args);
+            continue;
+        }
+        strcpy(path, "/bin/");
+        strcat(path, args[0]);
 
-            //If execv fails...
+        //Time to execute! The spawn layer reports exec failures back to us.
+        pids[i] = spawn_command(path, args, NULL);
+        if (pids[i] < 0) {
             write(STDERR_FILENO, error_msg, strlen(error_msg));
-            exit(1);
         }
+        free(path);
+        free(args);
     }
 
 
     //Parent waits for all children
     for (int i = 0; i < n; i++) {
-        waitpid(pids[i], NULL, 0);
+        if (pids[i] > 0) waitpid(pids[i], NULL, 0);
     }
+    free(pids);
 }
-
@@ -3,12 +3,15 @@
 
 #include<stdbool.h>
 
-#define arg_max 10
-
+//One command of a parsed line. All strings (and args itself) belong to the
+//line's parse arena, so they are only valid until the next line is parsed.
 typedef struct {
      char* name;
-     char* args[arg_max];
+     char** args;         //NULL-terminated argv, args[0] == name
      int arg_count;
+     char* redir_target;  //NULL when there is no '>'
+     bool invalid;        //Malformed redirection or pipeline, report and skip
+     bool pipe_next;      //stdout feeds the next Command's stdin ('|')
 } Command;
 
 void run_parallel_cmds(char* cmds[]);
@@ -0,0 +1,116 @@
+#include "parse.h"
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+static Arena line_arena;
+
+// Vectors reused from line to line; they only grow
+static Command *cmds = NULL;
+static int cmd_cap = 0;
+static char **argv_scratch = NULL;
+static int argv_cap = 0;
+
+static unsigned long lines_parsed = 0;
+static unsigned long vector_growths = 0;
+
+static int grow(void **vec, int *cap, size_t elem) {
+    int new_cap = *cap ? *cap * 2 : 16;
+    void *p = realloc(*vec, elem * new_cap);
+    if (!p) return -1;
+    *vec = p;
+    *cap = new_cap;
+    vector_growths++;
+    return 0;
+}
+
+static inline int is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+// Redirect state for the command being built
+enum { REDIR_NONE, REDIR_WANT_TARGET, REDIR_HAVE_TARGET };
+
+// Appends the command collected so far; piped says whether '|' ended it
+static int emit_command(int *count, int argc, char *target, bool invalid, bool piped) {
+    if (*count >= cmd_cap && grow((void **)&cmds, &cmd_cap, sizeof(Command)) != 0) return -1;
+    char **args = arena_alloc(&line_arena, sizeof(char*) * (argc + 1));
+    if (!args) return -1;
+    memcpy(args, argv_scratch, sizeof(char*) * argc);
+    args[argc] = NULL;
+    Command *cmd = &cmds[(*count)++];
+    cmd->name = argc > 0 ? args[0] : NULL;
+    cmd->args = args;
+    cmd->arg_count = argc;
+    cmd->redir_target = target;
+    cmd->invalid = invalid;
+    cmd->pipe_next = piped;
+    return 0;
+}
+
+Command *parse_line(const char *line, size_t len, int *out_count) {
+    int count = 0;
+    int argc = 0;
+    int redir = REDIR_NONE;
+    char *target = NULL;
+    bool invalid = false;
+    bool piped_in = false; // the previous stage pipes into this command
+    lines_parsed++;
+
+    size_t i = 0;
+    while (1) {
+        char c = i < len ? line[i] : '&'; // end of line closes the last command
+        if (is_blank(c)) {
+            i++;
+            continue;
+        }
+        if (c == '&' || c == '|') {
+            bool piped = c == '|';
+            if (redir == REDIR_WANT_TARGET) invalid = true; // '>' with no file
+            if (piped && target) invalid = true;            // only the last stage may redirect
+            if (argc == 0 && (piped || piped_in)) invalid = true; // empty pipeline stage
+            if (argc > 0 || invalid) {
+                if (emit_command(&count, argc, target, invalid, piped) != 0) return NULL;
+            }
+            if (i >= len) break;
+            piped_in = piped;
+            argc = 0;
+            redir = REDIR_NONE;
+            target = NULL;
+            invalid = false;
+            i++;
+            continue;
+        }
+        if (c == '>') {
+            if (redir != REDIR_NONE) invalid = true; // multiple redirections
+            redir = REDIR_WANT_TARGET;
+            i++;
+            continue;
+        }
+
+        size_t start = i;
+        while (i < len && !is_blank(line[i]) && line[i] != '&' && line[i] != '|' && line[i] != '>') i++;
+        if (redir == REDIR_HAVE_TARGET) continue; // words after the target are ignored
+        char *word = arena_strndup(&line_arena, line + start, i - start);
+        if (!word) return NULL;
+        if (redir == REDIR_WANT_TARGET) {
+            target = word;
+            redir = REDIR_HAVE_TARGET;
+        } else {
+            if (argc + 1 >= argv_cap && grow((void **)&argv_scratch, &argv_cap, sizeof(char*)) != 0) return NULL;
+            argv_scratch[argc++] = word;
+        }
+    }
+    *out_count = count;
+    return cmds;
+}
+
+void parse_reset(void) {
+    arena_reset(&line_arena);
+}
+
+void parse_get_stats(ParseStats *stats) {
+    stats->lines = lines_parsed;
+    stats->mallocs = line_arena.malloc_calls + vector_growths;
+    stats->arena_bytes = line_arena.total_cap;
+}
@@ -0,0 +1,26 @@
+#ifndef PARSE_H
+#define PARSE_H
+
+#include <stddef.h>
+#include "parallel.h"
+
+// Single-pass tokenizer: one scan over the line splits on '&' and '|', picks out
+// the '>' target and breaks words on spaces/tabs, writing Commands into the
+// parser's arena. Pipeline stages are consecutive Commands linked by
+// pipe_next. Returns the array of commands (count in *out_count), or NULL if
+// memory ran out. Commands stay valid until parse_reset().
+Command *parse_line(const char *line, size_t len, int *out_count);
+
+// Releases the memory of the last parsed line for reuse
+void parse_reset(void);
+
+// Counters used to confirm that parsing does not allocate in steady state
+typedef struct {
+    unsigned long lines;        // lines parsed
+    unsigned long mallocs;      // arena chunks plus vector growths
+    size_t arena_bytes;         // capacity currently held by the arena
+} ParseStats;
+
+void parse_get_stats(ParseStats *stats);
+
+#endif // PARSE_H
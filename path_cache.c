@@ -0,0 +1,177 @@
+#include "path_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "wish.h"
+#include "utils.h"
+
+#define PATH_CACHE_INITIAL_CAP 64
+
+typedef struct {
+    char *name;      // NULL marks an empty slot
+    char *path;      // only programs that were found are cached
+    uint64_t hash;
+} PathCacheEntry;
+
+static PathCacheEntry *entries = NULL;
+static size_t entry_cap = 0;
+static size_t entry_count = 0;
+
+// mtime of each shell_paths directory when the cache was last validated
+static struct timespec *dir_mtimes = NULL;
+static int dir_mtime_count = 0;
+
+static unsigned long generation = 0;
+static unsigned long cache_hits = 0;
+static unsigned long cache_misses = 0;
+static unsigned long access_probes = 0;
+
+static void clear_entries(void) {
+    for (size_t i = 0; i < entry_cap; i++) {
+        free(entries[i].name);
+        free(entries[i].path);
+        entries[i].name = NULL;
+        entries[i].path = NULL;
+    }
+    entry_count = 0;
+    generation++;
+}
+
+// Records the current mtime of every search directory
+static void snapshot_dir_mtimes(void) {
+    if (dir_mtime_count != shell_path_count) {
+        free(dir_mtimes);
+        dir_mtimes = shell_path_count > 0 ? calloc(shell_path_count, sizeof(struct timespec)) : NULL;
+        dir_mtime_count = dir_mtimes ? shell_path_count : 0;
+    }
+    for (int i = 0; i < dir_mtime_count; i++) {
+        struct stat st;
+        if (stat(shell_paths[i], &st) == 0) {
+            dir_mtimes[i] = st.st_mtim;
+        } else {
+            dir_mtimes[i].tv_sec = -1;
+            dir_mtimes[i].tv_nsec = 0;
+        }
+    }
+}
+
+// Flushes the cache if any search directory changed since the last snapshot.
+// Checked on every lookup: a program installed a moment ago must be found.
+static void revalidate(void) {
+    if (dir_mtime_count != shell_path_count) {
+        clear_entries();
+        snapshot_dir_mtimes();
+        return;
+    }
+    for (int i = 0; i < dir_mtime_count; i++) {
+        struct stat st;
+        struct timespec now = { -1, 0 };
+        if (stat(shell_paths[i], &st) == 0) now = st.st_mtim;
+        if (now.tv_sec != dir_mtimes[i].tv_sec || now.tv_nsec != dir_mtimes[i].tv_nsec) {
+            clear_entries();
+            snapshot_dir_mtimes();
+            return;
+        }
+    }
+}
+
+static PathCacheEntry *find_slot(const char *name, uint64_t h) {
+    size_t mask = entry_cap - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        if (!entries[i].name) return &entries[i];
+        if (entries[i].hash == h && strcmp(entries[i].name, name) == 0) return &entries[i];
+    }
+}
+
+static int grow_table(void) {
+    size_t new_cap = entry_cap ? entry_cap * 2 : PATH_CACHE_INITIAL_CAP;
+    PathCacheEntry *new_entries = calloc(new_cap, sizeof(PathCacheEntry));
+    if (!new_entries) return -1;
+    PathCacheEntry *old = entries;
+    size_t old_cap = entry_cap;
+    entries = new_entries;
+    entry_cap = new_cap;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old[i].name) *find_slot(old[i].name, old[i].hash) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+// Stores a lookup result; failures only cost a future re-probe, so they are silent
+static void insert_entry(const char *name, uint64_t h, const char *path) {
+    if ((entry_count + 1) * 4 > entry_cap * 3 && grow_table() != 0) return;
+    PathCacheEntry *slot = find_slot(name, h);
+    slot->name = strdup(name);
+    slot->path = strdup(path);
+    if (!slot->name || !slot->path) {
+        free(slot->name);
+        free(slot->path);
+        slot->name = NULL;
+        slot->path = NULL;
+        return;
+    }
+    slot->hash = h;
+    entry_count++;
+}
+
+static int copy_path(char *out, size_t out_len, const char *path) {
+    if (strlen(path) >= out_len) return 0;
+    strcpy(out, path);
+    return 1;
+}
+
+int resolve_executable(const char *name, char *out, size_t out_len) {
+    // Explicit paths bypass the search path and the cache
+    if (name[0] == '/' || (name[0] == '.' && name[1] == '/')) {
+        access_probes++;
+        if (access(name, X_OK) != 0) return 0;
+        return copy_path(out, out_len, name);
+    }
+
+    revalidate();
+    uint64_t h = hash_string(name);
+    if (entry_cap > 0) {
+        PathCacheEntry *slot = find_slot(name, h);
+        if (slot->name) {
+            cache_hits++;
+            return copy_path(out, out_len, slot->path);
+        }
+    }
+
+    cache_misses++;
+    for (int i = 0; i < shell_path_count; i++) {
+        int len = snprintf(out, out_len, "%s/%s", shell_paths[i], name);
+        if (len < 0 || (size_t)len >= out_len) continue;
+        access_probes++;
+        if (access(out, X_OK) == 0) {
+            insert_entry(name, h, out);
+            return 1;
+        }
+    }
+    // Misses are not cached: a chmod +x changes no directory mtime
+    return 0;
+}
+
+void path_cache_flush(void) {
+    clear_entries();
+    snapshot_dir_mtimes();
+}
+
+unsigned long path_cache_generation(void) {
+    revalidate();
+    return generation;
+}
+
+void path_cache_print_stats(void) {
+    printf("hits: %lu misses: %lu probes: %lu entries: %zu\n",
+           cache_hits, cache_misses, access_probes, entry_count);
+    for (size_t i = 0; i < entry_cap; i++) {
+        if (entries[i].name) {
+            printf("%s\t%s\n", entries[i].name, entries[i].path);
+        }
+    }
+}
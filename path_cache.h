@@ -0,0 +1,22 @@
+#ifndef PATH_CACHE_H
+#define PATH_CACHE_H
+
+#include <stddef.h>
+
+// Resolves a command name against shell_paths, consulting the cache first.
+// Only found programs are cached, so a miss always probes the directories again.
+// Returns 1 and writes the full path to out on success, 0 if not found.
+int resolve_executable(const char *name, char *out, size_t out_len);
+
+// Drops every cached entry (called when the `path` builtin rewrites shell_paths)
+void path_cache_flush(void);
+
+// Counter that changes whenever cached lookups may have gone stale (a search
+// directory changed or the cache was flushed). Rechecks the directories' mtimes
+// on every call, like resolve_executable.
+unsigned long path_cache_generation(void);
+
+// Prints hit/miss counters and the cached entries for the `hash` builtin
+void path_cache_print_stats(void);
+
+#endif // PATH_CACHE_H
@@ -0,0 +1,182 @@
+#define _GNU_SOURCE // For pipe2, splice, tee and F_SETPIPE_SZ
+#include "pipe_io.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define SPLICE_CHUNK (1 << 20)
+#define COPY_CHUNK 65536
+
+int pipe_buffer_size(void) {
+    static int size = -1;
+    if (size < 0) {
+        const char *env = getenv("WISH_PIPE_SIZE");
+        long n = env ? strtol(env, NULL, 10) : 0;
+        size = n > 0 && n <= (1L << 30) ? (int)n : 0;
+    }
+    return size;
+}
+
+int make_pipe(int fds[2]) {
+    if (pipe2(fds, O_CLOEXEC) != 0) return -1;
+    int size = pipe_buffer_size();
+    if (size > 0) {
+        // Best effort: the kernel caps it at /proc/sys/fs/pipe-max-size
+        fcntl(fds[1], F_SETPIPE_SZ, size);
+    }
+    return 0;
+}
+
+static int copy_all(int in_fd, int out_fd) {
+    char buf[COPY_CHUNK];
+    while (1) {
+        ssize_t n = read(in_fd, buf, sizeof(buf));
+        if (n == 0) return 0;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        for (ssize_t off = 0; off < n;) {
+            ssize_t w = write(out_fd, buf + off, n - off);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                return -1;
+            }
+            off += w;
+        }
+    }
+}
+
+int splice_all(int in_fd, int out_fd) {
+    while (1) {
+        ssize_t n = splice(in_fd, NULL, out_fd, NULL, SPLICE_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n == 0) return 0;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EINVAL || errno == ENOSYS) return copy_all(in_fd, out_fd);
+            return -1;
+        }
+    }
+}
+
+// Writes all of buf[0, n) to fd
+static int write_all(int fd, const char *buf, size_t n) {
+    for (size_t off = 0; off < n;) {
+        ssize_t w = write(fd, buf + off, n - off);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        off += (size_t)w;
+    }
+    return 0;
+}
+
+// Moves exactly n bytes from the pipe in_fd to out_fd, copying through user
+// space if out_fd does not take splice
+static int splice_exact(int in_fd, int out_fd, size_t n) {
+    while (n > 0) {
+        ssize_t m = splice(in_fd, NULL, out_fd, NULL, n, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (m < 0 && errno == EINTR) continue;
+        if (m < 0 && (errno == EINVAL || errno == ENOSYS)) {
+            char buf[COPY_CHUNK];
+            while (n > 0) {
+                ssize_t r = read(in_fd, buf, n < sizeof(buf) ? n : sizeof(buf));
+                if (r < 0 && errno == EINTR) continue;
+                if (r <= 0 || write_all(out_fd, buf, (size_t)r) != 0) return -1;
+                n -= (size_t)r;
+            }
+            return 0;
+        }
+        if (m <= 0) return -1;
+        n -= (size_t)m;
+    }
+    return 0;
+}
+
+int tee_all(int in_fd, int out_fd, int copy_fd) {
+    int mid[2];
+    if (make_pipe(mid) != 0) return -1;
+    int status = 0;
+    while (1) {
+        // Blocks until the producer writes; 0 once it has closed the pipe
+        ssize_t n = tee(in_fd, mid[1], SPLICE_CHUNK, 0);
+        if (n == 0) break;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            status = -1;
+            break;
+        }
+        if (splice_exact(mid[0], copy_fd, (size_t)n) != 0) {
+            // Like tee(1), a failing file does not stop the output
+            close(mid[0]);
+            close(mid[1]);
+            return splice_all(in_fd, out_fd);
+        }
+        if (splice_exact(in_fd, out_fd, (size_t)n) != 0) {
+            status = -1;
+            break;
+        }
+    }
+    close(mid[0]);
+    close(mid[1]);
+    return status;
+}
+
+static void *pump_thread(void *arg) {
+    SplicePump *pump = arg;
+    if (pump->copy_fd >= 0) {
+        tee_all(pump->in_fd, pump->out_fd, pump->copy_fd);
+        close(pump->copy_fd);
+    } else {
+        splice_all(pump->in_fd, pump->out_fd);
+    }
+    close(pump->in_fd);
+    close(pump->out_fd);
+    if (pump->detached) free(pump);
+    return NULL;
+}
+
+SplicePump *tee_pump_start(int in_fd, int out_fd, int copy_fd) {
+    SplicePump *pump = malloc(sizeof(SplicePump));
+    if (!pump) return NULL;
+    pump->in_fd = in_fd;
+    pump->out_fd = out_fd;
+    pump->copy_fd = copy_fd;
+    pump->detached = false;
+    if (pthread_create(&pump->thread, NULL, pump_thread, pump) != 0) {
+        free(pump);
+        return NULL;
+    }
+    return pump;
+}
+
+SplicePump *splice_pump_start(int in_fd, int out_fd) {
+    return tee_pump_start(in_fd, out_fd, -1);
+}
+
+int splice_pump_detach(int in_fd, int out_fd) {
+    SplicePump *pump = malloc(sizeof(SplicePump));
+    if (!pump) return -1;
+    pump->in_fd = in_fd;
+    pump->out_fd = out_fd;
+    pump->copy_fd = -1;
+    pump->detached = true;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int status = pthread_create(&pump->thread, &attr, pump_thread, pump);
+    pthread_attr_destroy(&attr);
+    if (status != 0) {
+        free(pump);
+        return -1;
+    }
+    return 0;
+}
+
+void splice_pump_join(SplicePump *pump) {
+    if (!pump) return;
+    pthread_join(pump->thread, NULL);
+    free(pump);
+}
@@ -0,0 +1,43 @@
+#ifndef PIPE_IO_H
+#define PIPE_IO_H
+
+#include <pthread.h>
+#include <stdbool.h>
+
+// Pipe buffer size requested for pipeline pipes via F_SETPIPE_SZ, taken from the
+// WISH_PIPE_SIZE environment variable (bytes). 0 keeps the kernel default.
+int pipe_buffer_size(void);
+
+// Creates a close-on-exec pipe sized per pipe_buffer_size()
+int make_pipe(int fds[2]);
+
+// Moves everything from in_fd to out_fd with splice(2), so the bytes stay in
+// kernel buffers; falls back to read/write when splice is not supported.
+// Returns 0, or -1 with errno set.
+int splice_all(int in_fd, int out_fd);
+
+// Moves everything from the pipe in_fd to both out_fd and copy_fd: tee(2)
+// duplicates each chunk into a private pipe for copy_fd, then both halves are
+// spliced, so the bytes still stay in kernel buffers. Falls back to read/write
+// when either destination does not take splice. Returns 0, or -1 with errno set.
+int tee_all(int in_fd, int out_fd, int copy_fd);
+
+// Runs splice_all (or tee_all, with a copy_fd) on a background thread and
+// closes the descriptors when done
+typedef struct {
+    pthread_t thread;
+    int in_fd;
+    int out_fd;
+    int copy_fd; // -1 unless the pump tees
+    bool detached;
+} SplicePump;
+
+SplicePump *splice_pump_start(int in_fd, int out_fd);
+SplicePump *tee_pump_start(int in_fd, int out_fd, int copy_fd);
+void splice_pump_join(SplicePump *pump);
+
+// Like splice_pump_start, on a thread nobody joins. Returns 0, or -1 if no
+// thread could be started (the descriptors are then left open).
+int splice_pump_detach(int in_fd, int out_fd);
+
+#endif // PIPE_IO_H
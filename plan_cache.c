@@ -0,0 +1,168 @@
+#include "plan_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "path_cache.h"
+#include "utils.h"
+
+#define PLAN_CACHE_INITIAL_CAP 256
+// Past this many distinct lines the script is not repetitive; start over
+// rather than grow without bound
+#define PLAN_CACHE_MAX_ENTRIES 8192
+
+typedef struct {
+    char *key;       // line text (not NUL-terminated), NULL marks an empty slot
+    size_t key_len;
+    uint64_t hash;
+    Plan *plan;      // key and plan share the allocation at plan
+} PlanEntry;
+
+static PlanEntry *entries = NULL;
+static size_t entry_cap = 0;
+static size_t entry_count = 0;
+static unsigned long path_generation = 0; // path cache generation the plans were resolved in
+
+static unsigned long plan_hits = 0;
+static unsigned long plan_misses = 0;
+
+static size_t align_up(size_t n) {
+    return (n + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+}
+
+void plan_cache_flush(void) {
+    for (size_t i = 0; i < entry_cap; i++) {
+        free(entries[i].plan);
+        entries[i].key = NULL;
+        entries[i].plan = NULL;
+    }
+    entry_count = 0;
+}
+
+static PlanEntry *find_slot(const char *line, size_t len, uint64_t h) {
+    size_t mask = entry_cap - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        PlanEntry *e = &entries[i];
+        if (!e->key) return e;
+        // The full text is compared, so a hash collision can never run the wrong plan
+        if (e->hash == h && e->key_len == len && memcmp(e->key, line, len) == 0) return e;
+    }
+}
+
+static int grow_table(void) {
+    size_t new_cap = entry_cap ? entry_cap * 2 : PLAN_CACHE_INITIAL_CAP;
+    PlanEntry *new_entries = calloc(new_cap, sizeof(PlanEntry));
+    if (!new_entries) return -1;
+    PlanEntry *old = entries;
+    size_t old_cap = entry_cap;
+    entries = new_entries;
+    entry_cap = new_cap;
+    for (size_t i = 0; i < old_cap; i++) {
+        if (old[i].key) *find_slot(old[i].key, old[i].key_len, old[i].hash) = old[i];
+    }
+    free(old);
+    return 0;
+}
+
+const Plan *plan_cache_lookup(const char *line, size_t len) {
+    // Resolved paths are only as fresh as the path cache they came from
+    unsigned long generation = path_cache_generation();
+    if (generation != path_generation) {
+        plan_cache_flush();
+        path_generation = generation;
+    }
+    if (entry_count > 0) {
+        PlanEntry *e = find_slot(line, len, hash_bytes(line, len));
+        if (e->key) {
+            plan_hits++;
+            return e->plan;
+        }
+    }
+    plan_misses++;
+    return NULL;
+}
+
+// Builds the plan, its tables, argv vectors and strings in one allocation
+// (*key_out points at the copy of the line inside it)
+static Plan *plan_create(const char *line, size_t len, const PlanGroup *groups, int group_count,
+                         char **key_out) {
+    size_t stage_total = 0, pointers = 0, strings = len;
+    for (int g = 0; g < group_count; g++) {
+        stage_total += groups[g].stage_count;
+        if (groups[g].redir_target) strings += strlen(groups[g].redir_target) + 1;
+        for (int s = 0; s < groups[g].stage_count; s++) {
+            const SchedStage *st = &groups[g].stages[s];
+            strings += strlen(st->program) + 1;
+            int argc = 0;
+            while (st->argv[argc]) strings += strlen(st->argv[argc++]) + 1;
+            pointers += argc + 1;
+        }
+    }
+
+    size_t header = align_up(sizeof(Plan));
+    size_t group_table = align_up(sizeof(PlanGroup) * group_count);
+    size_t stage_table = align_up(sizeof(SchedStage) * stage_total);
+    size_t argv_table = align_up(sizeof(char*) * pointers);
+    Plan *plan = malloc(header + group_table + stage_table + argv_table + strings);
+    if (!plan) return NULL;
+
+    char *base = (char *)plan;
+    plan->groups = (PlanGroup *)(base + header);
+    plan->group_count = group_count;
+    SchedStage *stage_slots = (SchedStage *)(base + header + group_table);
+    char **argv_slots = (char **)(base + header + group_table + stage_table);
+    char *p = base + header + group_table + stage_table + argv_table;
+
+    memcpy(p, line, len); // the key comes first in the string area
+    *key_out = p;
+    p += len;
+    for (int g = 0; g < group_count; g++) {
+        PlanGroup *dst = &plan->groups[g];
+        dst->stages = stage_slots;
+        dst->stage_count = groups[g].stage_count;
+        dst->flags = groups[g].flags;
+        dst->redir_target = NULL;
+        if (groups[g].redir_target) {
+            dst->redir_target = p;
+            p = stpcpy(p, groups[g].redir_target) + 1;
+        }
+        for (int s = 0; s < dst->stage_count; s++) {
+            const SchedStage *src = &groups[g].stages[s];
+            stage_slots[s].program = p;
+            p = stpcpy(p, src->program) + 1;
+            stage_slots[s].argv = argv_slots;
+            int argc = 0;
+            for (; src->argv[argc]; argc++) {
+                argv_slots[argc] = p;
+                p = stpcpy(p, src->argv[argc]) + 1;
+            }
+            argv_slots[argc] = NULL;
+            argv_slots += argc + 1;
+        }
+        stage_slots += dst->stage_count;
+    }
+    return plan;
+}
+
+const Plan *plan_cache_insert(const char *line, size_t len, const PlanGroup *groups, int group_count) {
+    if (entry_count >= PLAN_CACHE_MAX_ENTRIES) plan_cache_flush();
+    if ((entry_count + 1) * 4 > entry_cap * 3 && grow_table() != 0) return NULL;
+    char *key;
+    Plan *plan = plan_create(line, len, groups, group_count, &key);
+    if (!plan) return NULL;
+    uint64_t h = hash_bytes(line, len);
+    PlanEntry *e = find_slot(line, len, h);
+    free(e->plan); // only set if the same line was inserted twice
+    if (!e->key) entry_count++;
+    e->plan = plan;
+    e->key = key;
+    e->key_len = len;
+    e->hash = h;
+    return plan;
+}
+
+void plan_cache_print_stats(void) {
+    unsigned long lookups = plan_hits + plan_misses;
+    printf("hits: %lu misses: %lu hit rate: %.1f%% entries: %zu\n", plan_hits, plan_misses,
+           lookups ? 100.0 * plan_hits / lookups : 0.0, entry_count);
+}
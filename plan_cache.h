@@ -0,0 +1,38 @@
+#ifndef PLAN_CACHE_H
+#define PLAN_CACHE_H
+
+#include <stddef.h>
+#include "jobs.h"
+
+// Cache of compiled command lines. Generated batch files repeat the same lines
+// many times; a cached plan holds everything needed to submit them (argv vectors,
+// redirect targets and resolved executables), so a hit skips parsing and lookup.
+// Only lines made entirely of external commands that resolved are cached.
+
+// One pipeline of a line (a plain command is a pipeline of one stage)
+typedef struct {
+    SchedStage *stages;
+    int stage_count;
+    const char *redir_target; // applies to the last stage, NULL if none
+    int flags;                // SCHED_* flags for sched_submit_pipeline
+} PlanGroup;
+
+typedef struct {
+    PlanGroup *groups;
+    int group_count;
+} Plan;
+
+// Returns the plan cached for exactly this line text, or NULL
+const Plan *plan_cache_lookup(const char *line, size_t len);
+
+// Copies the groups into a new cache entry for the line. Returns the cached
+// copy, or NULL if it could not be stored.
+const Plan *plan_cache_insert(const char *line, size_t len, const PlanGroup *groups, int group_count);
+
+// Drops every plan (on `path` and `cd`, which change how names resolve)
+void plan_cache_flush(void);
+
+// Prints hit/miss counters for the `plans` builtin
+void plan_cache_print_stats(void);
+
+#endif // PLAN_CACHE_H
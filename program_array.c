@@ -1,10 +1,28 @@
+#define _GNU_SOURCE // For qsort_r
 #include "program_array.h"
 #include <stdlib.h>
 #include <string.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <errno.h>
 
+static const char *bin_dirs[] = {"/bin", "/usr/bin", "/usr/local/bin", "/sbin", "/usr/sbin", NULL};
+
+// Per-directory indexes for get_directory_programs
+typedef struct {
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    ProgramArray *programs;
+} DirIndex;
+
+static DirIndex *dir_indexes = NULL;
+static int dir_index_count = 0;
+static int dir_index_cap = 0;
+
 int is_executable(const char *filepath) {
     struct stat st;
     if (stat(filepath, &st) == 0) {
@@ -13,89 +31,235 @@ int is_executable(const char *filepath) {
     return 0;
 }
 
+static int init_program_array(ProgramArray *arr) {
+    arr->capacity = 100;
+    arr->count = 0;
+    arr->arena_cap = 4096;
+    arr->arena_len = 0;
+    arr->offsets = malloc(arr->capacity * sizeof(size_t));
+    arr->arena = malloc(arr->arena_cap);
+    if (!arr->offsets || !arr->arena) {
+        free(arr->offsets);
+        free(arr->arena);
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
 int add_program(ProgramArray *arr, const char *program) {
+    size_t len = strlen(program) + 1;
     if (arr->count >= arr->capacity) {
-        arr->capacity *= 2;
-        char **new_programs = realloc(arr->programs, arr->capacity * sizeof(char*));
-        if (!new_programs) {
+        int new_capacity = arr->capacity * 2;
+        size_t *new_offsets = realloc(arr->offsets, new_capacity * sizeof(size_t));
+        if (!new_offsets) {
             errno = ENOMEM;
             return -1;
         }
-        arr->programs = new_programs;
+        arr->offsets = new_offsets;
+        arr->capacity = new_capacity;
     }
-    arr->programs[arr->count] = malloc(strlen(program) + 1);
-    if (!arr->programs[arr->count]) {
-        errno = ENOMEM;
-        return -1;
+    if (arr->arena_len + len > arr->arena_cap) {
+        size_t new_cap = arr->arena_cap * 2;
+        while (arr->arena_len + len > new_cap) new_cap *= 2;
+        char *new_arena = realloc(arr->arena, new_cap);
+        if (!new_arena) {
+            errno = ENOMEM;
+            return -1;
+        }
+        arr->arena = new_arena;
+        arr->arena_cap = new_cap;
     }
-    strcpy(arr->programs[arr->count], program);
-    arr->count++;
+    memcpy(arr->arena + arr->arena_len, program, len);
+    arr->offsets[arr->count++] = arr->arena_len;
+    arr->arena_len += len;
     return 0;
 }
 
+// Uses d_type to skip directories and devices without a syscall; regular files
+// and symlinks need a single fstatat for their mode bits.
 int scan_bin_directory(ProgramArray *arr, const char *dir_path) {
     DIR *dir = opendir(dir_path);
     if (!dir) {
         return -1;
     }
+    int dfd = dirfd(dir);
     struct dirent *entry;
     while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+        if (entry->d_name[0] == '.' &&
+            (entry->d_name[1] == '\0' || (entry->d_name[1] == '.' && entry->d_name[2] == '\0'))) {
             continue;
         }
-        size_t path_len = strlen(dir_path) + 1 + strlen(entry->d_name) + 1;
-        char *filepath = malloc(path_len);
-        if (!filepath) {
-            closedir(dir);
-            errno = ENOMEM;
-            return -1;
-        }
-        int written = snprintf(filepath, path_len, "%s/%s", dir_path, entry->d_name);
-        if (written < 0 || (size_t)written >= path_len) {
-            free(filepath);
+        if (entry->d_type != DT_REG && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN) {
             continue;
         }
         struct stat st;
-        if (stat(filepath, &st) == 0 && S_ISREG(st.st_mode) && is_executable(filepath)) {
-            if (add_program(arr, entry->d_name) != 0) {
-                free(filepath);
-                closedir(dir);
-                return -1;
-            }
+        if (fstatat(dfd, entry->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        if (!(st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH))) {
+            continue;
+        }
+        if (add_program(arr, entry->d_name) != 0) {
+            closedir(dir);
+            return -1;
         }
-        free(filepath);
     }
     closedir(dir);
     return 0;
 }
 
+typedef struct {
+    const char *dir_path;
+    ProgramArray arr;
+    int ok;
+} ScanJob;
+
+static void *scan_thread(void *arg) {
+    ScanJob *job = arg;
+    job->ok = init_program_array(&job->arr) == 0;
+    if (job->ok) {
+        scan_bin_directory(&job->arr, job->dir_path);
+    }
+    return NULL;
+}
+
+static int compare_offsets(const void *a, const void *b, void *arena) {
+    return strcmp((const char *)arena + *(const size_t *)a, (const char *)arena + *(const size_t *)b);
+}
+
+static void sort_unique(ProgramArray *programs) {
+    qsort_r(programs->offsets, programs->count, sizeof(size_t), compare_offsets, programs->arena);
+    int unique = 0;
+    for (int i = 0; i < programs->count; i++) {
+        if (unique > 0 && strcmp(program_name(programs, unique - 1), program_name(programs, i)) == 0) {
+            continue;
+        }
+        programs->offsets[unique++] = programs->offsets[i];
+    }
+    programs->count = unique;
+}
+
+// Scans every bin directory concurrently, then merges the per-thread results into
+// one sorted, de-duplicated index.
 ProgramArray* get_all_programs() {
     ProgramArray *programs = malloc(sizeof(ProgramArray));
     if (!programs) {
         errno = ENOMEM;
         return NULL;
     }
-    programs->capacity = 100;
-    programs->count = 0;
-    programs->programs = malloc(programs->capacity * sizeof(char*));
-    if (!programs->programs) {
+    if (init_program_array(programs) != 0) {
         free(programs);
-        errno = ENOMEM;
         return NULL;
     }
-    const char *bin_dirs[] = {"/bin", "/usr/bin", "/usr/local/bin", "/sbin", "/usr/sbin", NULL};
-    for (int i = 0; bin_dirs[i] != NULL; i++) {
-        scan_bin_directory(programs, bin_dirs[i]);
+
+    enum { max_dirs = sizeof(bin_dirs) / sizeof(bin_dirs[0]) };
+    ScanJob jobs[max_dirs];
+    pthread_t threads[max_dirs];
+    int started[max_dirs];
+    int n = 0;
+    for (; bin_dirs[n] != NULL; n++) {
+        jobs[n].dir_path = bin_dirs[n];
+        jobs[n].ok = 0;
+        started[n] = pthread_create(&threads[n], NULL, scan_thread, &jobs[n]) == 0;
+        if (!started[n]) {
+            scan_thread(&jobs[n]);
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (!jobs[i].ok) continue;
+        for (int j = 0; j < jobs[i].arr.count; j++) {
+            add_program(programs, jobs[i].arr.arena + jobs[i].arr.offsets[j]);
+        }
+        free(jobs[i].arr.offsets);
+        free(jobs[i].arr.arena);
     }
+
+    sort_unique(programs);
     return programs;
 }
 
 void free_program_array(ProgramArray *arr) {
     if (arr) {
-        for (int i = 0; i < arr->count; i++) {
-            free(arr->programs[i]);
-        }
-        free(arr->programs);
+        free(arr->offsets);
+        free(arr->arena);
         free(arr);
     }
 }
+
+const char *program_name(const ProgramArray *arr, int i) {
+    return arr->arena + arr->offsets[i];
+}
+
+int find_programs_with_prefix(const ProgramArray *arr, const char *prefix, int *out_count) {
+    size_t plen = strlen(prefix);
+    int lo = 0, hi = arr->count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (strncmp(program_name(arr, mid), prefix, plen) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    int end = lo;
+    hi = arr->count;
+    while (end < hi) {
+        int mid = end + (hi - end) / 2;
+        if (strncmp(program_name(arr, mid), prefix, plen) == 0) end = mid + 1;
+        else hi = mid;
+    }
+    if (out_count) *out_count = end - lo;
+    return lo;
+}
+
+const ProgramArray *get_directory_programs(const char *dir_path) {
+    struct stat st;
+    int i = 0;
+    while (i < dir_index_count && strcmp(dir_indexes[i].path, dir_path) != 0) i++;
+    if (stat(dir_path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        if (i < dir_index_count) {
+            free_program_array(dir_indexes[i].programs);
+            free(dir_indexes[i].path);
+            dir_indexes[i] = dir_indexes[--dir_index_count];
+        }
+        return NULL;
+    }
+    if (i < dir_index_count) {
+        DirIndex *d = &dir_indexes[i];
+        if (d->dev == st.st_dev && d->ino == st.st_ino && d->mtime.tv_sec == st.st_mtim.tv_sec &&
+            d->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            return d->programs;
+        }
+    } else {
+        if (dir_index_count >= dir_index_cap) {
+            int new_cap = dir_index_cap ? dir_index_cap * 2 : 8;
+            DirIndex *new_indexes = realloc(dir_indexes, sizeof(DirIndex) * new_cap);
+            if (!new_indexes) return NULL;
+            dir_indexes = new_indexes;
+            dir_index_cap = new_cap;
+        }
+        char *path = strdup(dir_path);
+        if (!path) return NULL;
+        memset(&dir_indexes[i], 0, sizeof(DirIndex));
+        dir_indexes[i].path = path;
+        dir_index_count++;
+    }
+
+    // New or changed since the last scan: rescan this directory only
+    ProgramArray *programs = malloc(sizeof(ProgramArray));
+    if (!programs || init_program_array(programs) != 0) {
+        free(programs);
+        return dir_indexes[i].programs;
+    }
+    scan_bin_directory(programs, dir_path);
+    sort_unique(programs);
+    DirIndex *d = &dir_indexes[i];
+    free_program_array(d->programs);
+    d->programs = programs;
+    d->dev = st.st_dev;
+    d->ino = st.st_ino;
+    d->mtime = st.st_mtim;
+    return programs;
+}
@@ -2,10 +2,16 @@
 #define PROGRAM_ARRAY_H
 
 #include <stdio.h>
+#include <stddef.h>
 
-// Structure to hold the array of programs
+// Structure to hold the array of programs.
+// Names live back to back (NUL-terminated) in one arena; offsets indexes them
+// and is kept sorted by name once the index is built.
 typedef struct {
-    char **programs;
+    char *arena;
+    size_t arena_len;
+    size_t arena_cap;
+    size_t *offsets;
     int count;
     int capacity;
 } ProgramArray;
@@ -16,4 +22,16 @@ int scan_bin_directory(ProgramArray *arr, const char *dir_path);
 ProgramArray* get_all_programs();
 void free_program_array(ProgramArray *arr);
 
+// Name of the i-th program (in sorted order once built by get_all_programs)
+const char *program_name(const ProgramArray *arr, int i);
+
+// Index of the first program starting with prefix; *out_count receives how many match
+int find_programs_with_prefix(const ProgramArray *arr, const char *prefix, int *out_count);
+
+// Sorted index of the executables in one directory. Cached per directory and
+// rescanned only when the directory has changed since (its inode or mtime
+// differ), so a new search path costs a scan of the new directories alone.
+// NULL if the directory cannot be read.
+const ProgramArray *get_directory_programs(const char *dir_path);
+
 #endif // PROGRAM_ARRAY_H
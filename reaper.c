@@ -0,0 +1,233 @@
+#define _GNU_SOURCE // For pipe2
+#include "reaper.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "zygote.h"
+#include "uring.h"
+
+#define REAPER_MAX_EVENTS 64
+#define ZYGOTE_EVENT (~0ULL) // epoll data for the zygote socket (0 is the SIGCHLD pipe)
+#define RING_ZYGOTE_TAG (1ULL << 55) // ring poll tag for the zygote socket (tags are 56 bits)
+
+typedef struct {
+    pid_t pid;
+    int pidfd; // -1 when running on the SIGCHLD fallback
+    bool remote; // started by the zygote, which reports the exit
+    struct timespec started;
+} Watch;
+
+static Watch *watches = NULL;
+static int watch_count = 0;
+static int watch_cap = 0;
+
+static int epoll_fd = -1;
+static int use_pidfd = 1;
+static int sigchld_pipe[2] = { -1, -1 };
+static int zygote_registered = 0;
+static int remote_count = 0;
+
+// With the io_uring core, pidfds and the zygote socket are polled on the ring
+// instead of the epoll set. Needs pidfds; the SIGCHLD fallback stays on epoll.
+static bool ring_reaping = false;
+static bool zygote_armed = false; // ring polls are one-shot
+
+static void sigchld_handler(int sig) {
+    (void)sig;
+    int saved = errno;
+    write(sigchld_pipe[1], "", 1);
+    errno = saved;
+}
+
+static int install_sigchld_pipe(void) {
+    if (sigchld_pipe[0] >= 0) return 0;
+    if (pipe2(sigchld_pipe, O_CLOEXEC | O_NONBLOCK) != 0) return -1;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigchld_handler;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGCHLD, &sa, NULL) != 0) return -1;
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = 0 };
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sigchld_pipe[0], &ev);
+}
+
+static int ensure_epoll(void) {
+    if (epoll_fd >= 0) return 0;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    ring_reaping = uring_active();
+    return epoll_fd >= 0 ? 0 : -1;
+}
+
+int reaper_fd(void) {
+    return ring_reaping ? uring_fd() : epoll_fd;
+}
+
+bool reaper_exit_pending(void) {
+    for (int i = 0; remote_count > 0 && i < watch_count; i++) {
+        if (watches[i].remote && zygote_exit_reported(watches[i].pid)) return true;
+    }
+    return false;
+}
+
+int reaper_watched_count(void) {
+    return watch_count;
+}
+
+// The zygote's children are not ours to wait for; their exits arrive on its socket
+static int watch_remote(pid_t pid) {
+    if (!zygote_registered && !ring_reaping) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.u64 = ZYGOTE_EVENT };
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, zygote_fd(), &ev) != 0) return -1;
+        zygote_registered = 1;
+    }
+    Watch *w = &watches[watch_count++];
+    w->pid = pid;
+    w->pidfd = -1;
+    w->remote = true;
+    clock_gettime(CLOCK_MONOTONIC, &w->started);
+    remote_count++;
+    return 0;
+}
+
+int reaper_watch(pid_t pid) {
+    if (ensure_epoll() != 0) return -1;
+    if (watch_count >= watch_cap) {
+        int new_cap = watch_cap ? watch_cap * 2 : 16;
+        Watch *new_watches = realloc(watches, sizeof(Watch) * new_cap);
+        if (!new_watches) return -1;
+        watches = new_watches;
+        watch_cap = new_cap;
+    }
+    if (zygote_owns(pid)) return watch_remote(pid);
+
+    int pidfd = -1;
+    if (use_pidfd) {
+        pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+        if (pidfd < 0 && (errno == ENOSYS || errno == EINVAL)) {
+            use_pidfd = 0;
+            ring_reaping = false;
+        } else if (pidfd < 0) {
+            return -1;
+        }
+    }
+    if (pidfd >= 0 && ring_reaping) {
+        if (uring_poll_add(pidfd, (uint64_t)pid) != 0) {
+            close(pidfd);
+            return -1;
+        }
+    } else if (pidfd >= 0) {
+        struct epoll_event ev = { .events = EPOLLIN, .data.u64 = (unsigned long long)pid };
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pidfd, &ev) != 0) {
+            close(pidfd);
+            return -1;
+        }
+    } else if (install_sigchld_pipe() != 0) {
+        return -1;
+    }
+
+    Watch *w = &watches[watch_count++];
+    w->pid = pid;
+    w->pidfd = pidfd;
+    w->remote = false;
+    clock_gettime(CLOCK_MONOTONIC, &w->started);
+    return 0;
+}
+
+// Collects the watched child at index i if it has exited
+static int try_collect(int i, ReapedChild *out) {
+    int status;
+    if (watches[i].remote) {
+        if (!zygote_take_exit(watches[i].pid, &status, &out->usage)) return 0;
+        remote_count--;
+    } else {
+        pid_t r = wait4(watches[i].pid, &status, WNOHANG, &out->usage);
+        if (r == 0) return 0;
+        if (r < 0 && errno != ECHILD) return 0;
+        if (r < 0) {
+            memset(&out->usage, 0, sizeof(out->usage));
+            status = 0;
+        }
+    }
+    out->pid = watches[i].pid;
+    out->status = status;
+    out->started = watches[i].started;
+    clock_gettime(CLOCK_MONOTONIC, &out->exited);
+    if (watches[i].pidfd >= 0) {
+        // A ring poll is one-shot and has already fired
+        if (!ring_reaping) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, watches[i].pidfd, NULL);
+        close(watches[i].pidfd);
+    }
+    watches[i] = watches[--watch_count];
+    return 1;
+}
+
+// Waits for watched descriptors to become readable and fills tags with what
+// they were registered under (ZYGOTE_EVENT, 0 for the SIGCHLD pipe, or a pid).
+// Returns the number of tags, 0 on timeout, or -1 with errno set.
+static int next_events(uint64_t *tags, int timeout_ms) {
+    if (ring_reaping) {
+        if (remote_count > 0 && !zygote_armed) {
+            if (uring_poll_add(zygote_fd(), RING_ZYGOTE_TAG) != 0) return -1;
+            zygote_armed = true;
+        }
+        int r = uring_next_poll(&tags[0], timeout_ms);
+        if (r == 1 && tags[0] == RING_ZYGOTE_TAG) {
+            zygote_armed = false;
+            tags[0] = ZYGOTE_EVENT;
+        }
+        return r;
+    }
+    struct epoll_event events[REAPER_MAX_EVENTS];
+    int n = epoll_wait(epoll_fd, events, REAPER_MAX_EVENTS, timeout_ms);
+    for (int e = 0; e < n; e++) tags[e] = events[e].data.u64;
+    return n;
+}
+
+int reaper_wait(ReapedChild *out, int timeout_ms) {
+    while (watch_count > 0) {
+        // The SIGCHLD fallback may have missed a wakeup that fired before the
+        // handler was installed, so poll the watched children directly first.
+        if (!use_pidfd) {
+            for (int i = 0; i < watch_count; i++) {
+                if (!watches[i].remote && try_collect(i, out)) return 1;
+            }
+        }
+        // Zygote exit reports may already have been read while spawning
+        if (remote_count > 0) {
+            zygote_pump();
+            for (int i = 0; i < watch_count; i++) {
+                if (watches[i].remote && try_collect(i, out)) return 1;
+            }
+        }
+
+        uint64_t tags[REAPER_MAX_EVENTS];
+        int n = next_events(tags, timeout_ms);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) return 0;
+
+        for (int e = 0; e < n; e++) {
+            if (tags[e] == ZYGOTE_EVENT) continue; // read at the top of the loop
+            pid_t pid = (pid_t)tags[e];
+            if (pid == 0) {
+                char buf[64];
+                while (read(sigchld_pipe[0], buf, sizeof(buf)) > 0) {}
+                continue;
+            }
+            for (int i = 0; i < watch_count; i++) {
+                if (watches[i].pid == pid && try_collect(i, out)) return 1;
+            }
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,39 @@
+#ifndef REAPER_H
+#define REAPER_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <time.h>
+#include <sys/resource.h>
+
+// Event-driven child reaper. Watched children are collected in the order they
+// exit, using pidfd_open + epoll (or pidfd polls on the io_uring core when it is
+// active), or a SIGCHLD self-pipe on kernels without pidfds.
+// Children started by the zygote are reported through its socket instead.
+
+typedef struct {
+    pid_t pid;
+    int status;              // wait status as returned by waitpid
+    struct timespec started; // CLOCK_MONOTONIC when the child was watched
+    struct timespec exited;  // CLOCK_MONOTONIC when the exit was collected
+    struct rusage usage;     // resources used by the child (from wait4)
+} ReapedChild;
+
+// Starts watching a freshly spawned child. Returns 0, or -1 if it cannot be
+// watched (the caller must then waitpid for it itself).
+int reaper_watch(pid_t pid);
+
+// Waits up to timeout_ms (-1 = forever) for the next watched child to exit.
+// Returns 1 and fills out, 0 on timeout, or -1 if nothing is being watched.
+int reaper_wait(ReapedChild *out, int timeout_ms);
+
+int reaper_watched_count(void);
+
+// True if an exit has already been received and reaper_wait will return at once
+// (reaper_fd does not signal those)
+bool reaper_exit_pending(void);
+
+// The epoll descriptor that becomes readable when a watched child exits (or -1)
+int reaper_fd(void);
+
+#endif // REAPER_H
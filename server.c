@@ -0,0 +1,471 @@
+#define _GNU_SOURCE // For accept4, MSG_CMSG_CLOEXEC and memfd_create
+#include "server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include "wish.h"
+#include "command.h"
+#include "jobs.h"
+#include "reaper.h"
+#include "linescan.h"
+
+#define SERVE_MAX_EVENTS 64
+
+typedef struct {
+    int fd;
+    int out_fd;   // where the client's commands write, -1 until it sends them
+    int err_fd;
+    int node;     // scheduler node of the running request, -1 when idle
+    bool exiting; // ran `exit`: close once the request has been answered
+    bool sending; // the shell's own output for the request is still being sent
+} Client;
+
+// What the shell itself wrote for a request (builtin output, error messages),
+// sent to the client on its own thread so a slow reader never stalls the loop
+typedef struct {
+    Client *client;
+    int mem_fds[2];  // stdout and stderr as written
+    int dest_fds[2]; // the client's, dup'd
+} Delivery;
+
+static Client **clients = NULL;
+static int client_count = 0;
+static int client_cap = 0;
+
+static int epoll_fd = -1;
+static int saved_stdout = -1; // the server's own output, restored after each request
+static int saved_stderr = -1;
+static volatile sig_atomic_t stopping = 0;
+static int delivered[2] = { -1, -1 }; // delivery threads post their Client here
+
+static void stop_handler(int sig) {
+    (void)sig;
+    stopping = 1;
+}
+
+// A handler rather than SIG_IGN: a client that goes away must not take the
+// server with it, and exec resets handlers, so children still get SIGPIPE
+static void pipe_handler(int sig) {
+    (void)sig;
+}
+
+static int fill_address(struct sockaddr_un *addr, const char *path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+// Binds a listening socket at path, replacing a stale socket file but not a
+// live server
+static int listen_at(const char *path) {
+    struct sockaddr_un addr;
+    if (fill_address(&addr, path) != 0) return -1;
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0) return -1;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        int probe = errno == EADDRINUSE ? serve_connect(path) : -1;
+        if (probe >= 0) {
+            close(probe);
+            close(fd);
+            errno = EADDRINUSE;
+            return -1;
+        }
+        if (errno != ECONNREFUSED || unlink(path) != 0 ||
+            bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            int err = errno;
+            close(fd);
+            errno = err;
+            return -1;
+        }
+    }
+    if (listen(fd, SOMAXCONN) != 0) {
+        int err = errno;
+        close(fd);
+        unlink(path);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+static void watch_client(Client *c, int op) {
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+    epoll_ctl(epoll_fd, op, c->fd, &ev);
+}
+
+static void accept_clients(int listen_fd) {
+    int fd;
+    while ((fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK)) >= 0) {
+        if (client_count >= client_cap) {
+            int new_cap = client_cap ? client_cap * 2 : 16;
+            Client **p = realloc(clients, sizeof(Client*) * new_cap);
+            if (!p) {
+                close(fd);
+                continue;
+            }
+            clients = p;
+            client_cap = new_cap;
+        }
+        Client *c = malloc(sizeof(Client));
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        *c = (Client){ fd, -1, -1, -1, false, false };
+        clients[client_count++] = c;
+        watch_client(c, EPOLL_CTL_ADD);
+    }
+}
+
+static void close_client(Client *c) {
+    // Removed explicitly: a child forked but not yet exec'd may still share
+    // the socket, and then closing it would not end its registration
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    if (c->out_fd >= 0) close(c->out_fd);
+    if (c->err_fd >= 0) close(c->err_fd);
+    for (int i = 0; i < client_count; i++) {
+        if (clients[i] == c) {
+            clients[i] = clients[--client_count];
+            break;
+        }
+    }
+    free(c);
+}
+
+static void reply(Client *c, int status) {
+    ServeReply r = { status };
+    if (send(c->fd, &r, sizeof(r), MSG_NOSIGNAL) != (ssize_t)sizeof(r) || c->exiting) {
+        close_client(c);
+    }
+}
+
+static void *deliver_thread(void *arg) {
+    Delivery *d = arg;
+    for (int i = 0; i < 2; i++) {
+        off_t off = 0;
+        off_t len = lseek(d->mem_fds[i], 0, SEEK_END);
+        while (off < len) {
+            ssize_t n = sendfile(d->dest_fds[i], d->mem_fds[i], &off, len - off);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break; // the client is gone
+        }
+        close(d->mem_fds[i]);
+        close(d->dest_fds[i]);
+    }
+    write(delivered[1], &d->client, sizeof(d->client));
+    free(d);
+    return NULL;
+}
+
+// Hands the captured output to a delivery thread; c is not answered until it is done
+static void deliver(Client *c, int mem_fds[2]) {
+    Delivery *d = malloc(sizeof(Delivery));
+    if (d) {
+        *d = (Delivery){ c, { mem_fds[0], mem_fds[1] },
+                         { fcntl(c->out_fd, F_DUPFD_CLOEXEC, 0), fcntl(c->err_fd, F_DUPFD_CLOEXEC, 0) } };
+    }
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    if (d && d->dest_fds[0] >= 0 && d->dest_fds[1] >= 0 &&
+        pthread_create(&thread, &attr, deliver_thread, d) == 0) {
+        c->sending = true;
+    } else {
+        // Dropped rather than written here, where it could block every client
+        for (int i = 0; i < 2; i++) {
+            close(mem_fds[i]);
+            if (d && d->dest_fds[i] >= 0) close(d->dest_fds[i]);
+        }
+        free(d);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+// Runs a request's line. Its commands write to the client's descriptors
+// directly; what the shell itself writes (builtins, errors) is captured in
+// memfds and delivered afterwards.
+static void start_request(Client *c, const char *line, size_t len) {
+    int mem_fds[2] = { -1, -1 };
+    if (c->out_fd >= 0) {
+        mem_fds[0] = memfd_create("wish-request-out", MFD_CLOEXEC);
+        mem_fds[1] = memfd_create("wish-request-err", MFD_CLOEXEC);
+    }
+    bool captured = mem_fds[0] >= 0 && mem_fds[1] >= 0;
+    fflush(stdout);
+    if (captured) {
+        dup2(mem_fds[0], STDOUT_FILENO);
+        dup2(mem_fds[1], STDERR_FILENO);
+    }
+    unsigned long errors = shell_error_count;
+    bool exited = false;
+    int node = process_detached_view(line, len, c->out_fd, c->err_fd, &exited);
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    dup2(saved_stderr, STDERR_FILENO);
+    if (captured) {
+        if (lseek(mem_fds[0], 0, SEEK_END) > 0 || lseek(mem_fds[1], 0, SEEK_END) > 0) {
+            deliver(c, mem_fds);
+        } else {
+            close(mem_fds[0]);
+            close(mem_fds[1]);
+        }
+    } else {
+        if (mem_fds[0] >= 0) close(mem_fds[0]);
+        if (mem_fds[1] >= 0) close(mem_fds[1]);
+    }
+
+    c->exiting = exited;
+    if (node < 0) {
+        // Nothing runs, but the answer still waits for the delivery
+        node = sched_node_open(NULL, 0);
+        if (node >= 0) {
+            sched_node_close(node);
+            sched_node_set_status(node, 1);
+        }
+    }
+    if (node < 0) {
+        reply(c, 1);
+        return;
+    }
+    if (shell_error_count != errors) sched_node_set_status(node, 1);
+    c->node = node;
+    // Further requests wait in the socket until this one is answered
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+}
+
+// Marks the clients whose delivery threads have finished
+static void collect_deliveries(void) {
+    Client *c;
+    while (read(delivered[0], &c, sizeof(c)) == (ssize_t)sizeof(c)) {
+        c->sending = false;
+    }
+}
+
+// Reads one request from a readable client and starts it
+static void read_request(Client *c) {
+    // A seqpacket message is read whole, so ask for its size first
+    ssize_t size = recv(c->fd, NULL, 0, MSG_PEEK | MSG_TRUNC);
+    if (size < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    if (size <= 0) {
+        close_client(c); // hung up
+        return;
+    }
+    char *line = malloc(size);
+    if (!line) {
+        close_client(c);
+        return;
+    }
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * 2)];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { line, (size_t)size };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1,
+                          .msg_control = control.buf, .msg_controllen = sizeof(control.buf) };
+    ssize_t n = recvmsg(c->fd, &msg, MSG_CMSG_CLOEXEC);
+    if (n <= 0) {
+        free(line);
+        close_client(c);
+        return;
+    }
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) continue;
+        int fds[2];
+        size_t count = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        if (count != 2) {
+            for (size_t i = 0; i < count && i < 2; i++) {
+                memcpy(&fds[0], CMSG_DATA(cm) + i * sizeof(int), sizeof(int));
+                close(fds[0]);
+            }
+            continue;
+        }
+        memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+        if (c->out_fd >= 0) close(c->out_fd);
+        if (c->err_fd >= 0) close(c->err_fd);
+        c->out_fd = fds[0];
+        c->err_fd = fds[1];
+    }
+
+    size_t len = (size_t)n;
+    const char *view = trim_view(line, &len);
+    if (len == 0) {
+        reply(c, 0);
+    } else {
+        start_request(c, view, len);
+    }
+    free(line);
+}
+
+// Answers every request whose commands have all finished
+static void finish_requests(void) {
+    for (int i = client_count - 1; i >= 0; i--) {
+        Client *c = clients[i];
+        if (c->node < 0 || c->sending || !sched_node_done(c->node)) continue;
+        int status = sched_node_status(c->node);
+        sched_node_release(c->node);
+        c->node = -1;
+        if (!c->exiting) watch_client(c, EPOLL_CTL_ADD);
+        reply(c, status);
+    }
+}
+
+int serve(const char *path) {
+    int listen_fd = listen_at(path);
+    if (listen_fd < 0) return -1;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    saved_stdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    saved_stderr = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    struct epoll_event dev = { .events = EPOLLIN, .data.ptr = delivered };
+    if (epoll_fd < 0 || saved_stdout < 0 || saved_stderr < 0 ||
+        pipe2(delivered, O_CLOEXEC) != 0 || fcntl(delivered[0], F_SETFL, O_NONBLOCK) != 0 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) != 0 ||
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, delivered[0], &dev) != 0) {
+        int err = errno;
+        close(listen_fd);
+        unlink(path);
+        errno = err;
+        return -1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_handler; // no SA_RESTART, so epoll_wait returns
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = pipe_handler;
+    sigaction(SIGPIPE, &sa, NULL);
+
+    // The reaper's descriptor exists once the first child is watched
+    int watched_reaper_fd = -1;
+    while (!stopping) {
+        if (reaper_fd() >= 0 && reaper_fd() != watched_reaper_fd) {
+            watched_reaper_fd = reaper_fd();
+            struct epoll_event rev = { .events = EPOLLIN, .data.ptr = &watched_reaper_fd };
+            epoll_ctl(epoll_fd, EPOLL_CTL_ADD, watched_reaper_fd, &rev);
+        }
+        struct epoll_event events[SERVE_MAX_EVENTS];
+        int n = epoll_wait(epoll_fd, events, SERVE_MAX_EVENTS, reaper_exit_pending() ? 0 : -1);
+        if (n < 0 && errno != EINTR) break;
+        for (int e = 0; e < n; e++) {
+            void *tag = events[e].data.ptr;
+            if (!tag) {
+                accept_clients(listen_fd);
+            } else if (tag == delivered) {
+                collect_deliveries();
+            } else if (tag != &watched_reaper_fd) {
+                read_request(tag);
+            }
+            // Child exits are collected below
+        }
+        sched_poll();
+        finish_requests();
+    }
+
+    close(listen_fd);
+    unlink(path);
+    sched_wait_all();
+    finish_requests();
+    while (client_count > 0) close_client(clients[0]);
+    return 0;
+}
+
+int serve_connect(const char *path) {
+    struct sockaddr_un addr;
+    if (fill_address(&addr, path) != 0) return -1;
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+int serve_request(int fd, const char *line, size_t len, int out_fd, int err_fd) {
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * 2)];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { (void *)line, len };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+    if (out_fd >= 0) {
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(sizeof(int) * 2);
+        int fds[2] = { out_fd, err_fd };
+        memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+    }
+    ssize_t sent;
+    while ((sent = sendmsg(fd, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR) {}
+    if (sent < 0) return -1;
+
+    ServeReply r;
+    ssize_t got;
+    while ((got = recv(fd, &r, sizeof(r), 0)) < 0 && errno == EINTR) {}
+    if (got != (ssize_t)sizeof(r)) {
+        if (got >= 0) errno = ECONNRESET;
+        return -1;
+    }
+    return r.status;
+}
+
+int serve_client(const char *path, const char *line) {
+    int fd = serve_connect(path);
+    if (fd < 0) {
+        print_errno();
+        return 1;
+    }
+    int status = 0;
+    if (line) {
+        status = serve_request(fd, line, strlen(line), STDOUT_FILENO, STDERR_FILENO);
+    } else {
+        char *buf = NULL;
+        size_t cap = 0;
+        ssize_t n;
+        bool first = true;
+        while (status >= 0 && (n = getline(&buf, &cap, stdin)) >= 0) {
+            if (n > 0 && buf[n - 1] == '\n') n--;
+            if (n == 0) continue; // an empty message would read as a hangup
+            // The descriptors stay with the connection after the first request
+            int result = first ? serve_request(fd, buf, n, STDOUT_FILENO, STDERR_FILENO)
+                               : serve_request(fd, buf, n, -1, -1);
+            // A server that hangs up between requests has run an `exit`
+            if (result < 0 && errno == EPIPE && !first) break;
+            status = result;
+            first = false;
+        }
+        free(buf);
+    }
+    close(fd);
+    if (status < 0) {
+        print_errno();
+        return 1;
+    }
+    return status > 255 ? 255 : status;
+}
@@ -0,0 +1,46 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+
+// Command server. `wish --serve PATH` listens on a Unix socket and runs the
+// lines its clients send in one resident shell, so every request reuses the
+// warm executable lookup and plan caches and shares the scheduler's job
+// slots. Requests from different clients run concurrently; a client's own
+// requests run one after another.
+//
+// Each request is one SOCK_SEQPACKET message holding the line. It may carry
+// two descriptors (SCM_RIGHTS), the client's stdout and stderr, which the
+// line's commands then write to directly, so output streams to the client as
+// it is produced and is never copied through the server. Commands always run
+// as children there, never in-process; what the shell itself writes for a
+// request (builtin output, errors) is captured and sent by a separate thread,
+// so a client that reads slowly holds up only itself. The reply is a
+// ServeReply sent once every command of the line has finished. Builtins such
+// as cd and path change the shell all clients share, and take effect at once
+// rather than after the commands other clients have queued; `wait` returns
+// at once, since the reply already waits for the request's own commands.
+// `exit` ends the session. Nothing a request runs blocks the server.
+
+typedef struct {
+    int status; // exit status of the line's first failing command, else 0
+} ServeReply;
+
+// Serves clients on the socket at path until SIGINT or SIGTERM. Returns 0, or
+// -1 with errno set if the socket could not be set up.
+int serve(const char *path);
+
+// Connects to the server at path. Returns the socket, or -1 with errno set.
+int serve_connect(const char *path);
+
+// Runs the line [line, line + len) on the server and waits for it to finish.
+// out_fd/err_fd (when out_fd >= 0) become the connection's output for this
+// and later requests. Returns the line's exit status, or -1 with errno set.
+int serve_request(int fd, const char *line, size_t len, int out_fd, int err_fd);
+
+// The tiny client for `wish --client PATH [LINE]`: runs LINE, or each line of
+// stdin, on the server with this process's stdout and stderr. Returns the
+// exit status of the last line, or 1 if the server could not be reached.
+int serve_client(const char *path, const char *line);
+
+#endif // SERVER_H
@@ -0,0 +1,134 @@
+#define _GNU_SOURCE // For pipe2
+#include "spawn.h"
+#include "affinity.h"
+#include "env.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#ifdef WISH_SPAWN_FORK
+static SpawnMode spawn_mode = SPAWN_FORK;
+#else
+static SpawnMode spawn_mode = SPAWN_POSIX;
+#endif
+static int mode_initialized = 0;
+
+SpawnMode spawn_get_mode(void) {
+    if (!mode_initialized) {
+        const char *env = getenv("WISH_SPAWN");
+        if (env && strcmp(env, "fork") == 0) spawn_mode = SPAWN_FORK;
+        else if (env && strcmp(env, "posix") == 0) spawn_mode = SPAWN_POSIX;
+        mode_initialized = 1;
+    }
+    return spawn_mode;
+}
+
+void spawn_set_mode(SpawnMode mode) {
+    spawn_mode = mode;
+    mode_initialized = 1;
+}
+
+static pid_t spawn_posix(const char *program, char *const argv[], const char *redir_target,
+                         int stdin_fd, int stdout_fd, int stderr_fd) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_t *actions_ptr = NULL;
+    if (redir_target || stdin_fd >= 0 || stdout_fd >= 0 || stderr_fd >= 0) {
+        if (posix_spawn_file_actions_init(&actions) != 0) return -1;
+        actions_ptr = &actions;
+        int err = 0;
+        if (stdin_fd >= 0) err = posix_spawn_file_actions_adddup2(&actions, stdin_fd, STDIN_FILENO);
+        if (err == 0 && stdout_fd >= 0) err = posix_spawn_file_actions_adddup2(&actions, stdout_fd, STDOUT_FILENO);
+        if (err == 0 && stderr_fd >= 0) err = posix_spawn_file_actions_adddup2(&actions, stderr_fd, STDERR_FILENO);
+        if (err == 0 && redir_target) {
+            err = posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, redir_target,
+                                                   O_CREAT | O_WRONLY | O_TRUNC, 0644);
+            if (err == 0) err = posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+        }
+        if (err != 0) {
+            posix_spawn_file_actions_destroy(&actions);
+            errno = err;
+            return -1;
+        }
+    }
+    pid_t pid;
+    int err = posix_spawn(&pid, program, actions_ptr, NULL, argv, env_block());
+    if (actions_ptr) posix_spawn_file_actions_destroy(actions_ptr);
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+// Classic fork+execve. A close-on-exec pipe carries the child's errno back so that
+// failures are reported to the caller exactly like the posix_spawn path.
+static pid_t spawn_fork(const char *program, char *const argv[], const char *redir_target,
+                        int stdin_fd, int stdout_fd, int stderr_fd, int cpu) {
+    char *const *envp = env_block(); // the child must not allocate
+    int err_pipe[2];
+    if (pipe2(err_pipe, O_CLOEXEC) != 0) return -1;
+    pid_t pid = fork();
+    if (pid < 0) {
+        int saved = errno;
+        close(err_pipe[0]);
+        close(err_pipe[1]);
+        errno = saved;
+        return -1;
+    } else if (pid == 0) {
+        close(err_pipe[0]);
+        if (cpu >= 0) affinity_pin(0, cpu); // placement is advisory; a failure does not stop the launch
+        if (stdin_fd >= 0 && dup2(stdin_fd, STDIN_FILENO) < 0) goto fail;
+        if (stdout_fd >= 0 && dup2(stdout_fd, STDOUT_FILENO) < 0) goto fail;
+        if (stderr_fd >= 0 && dup2(stderr_fd, STDERR_FILENO) < 0) goto fail;
+        if (redir_target) {
+            int fd = open(redir_target, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+            if (fd < 0) goto fail;
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        execve(program, argv, envp);
+    fail:;
+        int child_err = errno;
+        write(err_pipe[1], &child_err, sizeof(child_err));
+        _exit(127);
+    }
+    close(err_pipe[1]);
+    int child_err = 0;
+    ssize_t n;
+    while ((n = read(err_pipe[0], &child_err, sizeof(child_err))) < 0 && errno == EINTR) {}
+    close(err_pipe[0]);
+    if (n == (ssize_t)sizeof(child_err)) {
+        waitpid(pid, NULL, 0);
+        errno = child_err;
+        return -1;
+    }
+    return pid;
+}
+
+pid_t spawn_command_on(const char *program, char *const argv[], const char *redir_target,
+                       int stdin_fd, int stdout_fd, int stderr_fd, int cpu) {
+    if (spawn_get_mode() == SPAWN_FORK) {
+        return spawn_fork(program, argv, redir_target, stdin_fd, stdout_fd, stderr_fd, cpu);
+    }
+    pid_t pid = spawn_posix(program, argv, redir_target, stdin_fd, stdout_fd, stderr_fd);
+    // posix_spawn has no affinity attribute. Pinning the new process from here
+    // costs one syscall, where switching the shell's own mask around the call
+    // would migrate the shell on every launch.
+    if (pid > 0 && cpu >= 0) affinity_pin(pid, cpu);
+    return pid;
+}
+
+pid_t spawn_command_fds(const char *program, char *const argv[], const char *redir_target,
+                        int stdin_fd, int stdout_fd, int stderr_fd) {
+    return spawn_command_on(program, argv, redir_target, stdin_fd, stdout_fd, stderr_fd,
+                            affinity_next_cpu());
+}
+
+pid_t spawn_command(const char *program, char *const argv[], const char *redir_target) {
+    return spawn_command_fds(program, argv, redir_target, -1, -1, -1);
+}
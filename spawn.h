@@ -0,0 +1,35 @@
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <sys/types.h>
+
+// Launch backends. posix_spawn avoids copying the parent's page tables (glibc
+// runs it on a CLONE_VM|CLONE_VFORK child); fork is kept for comparison.
+// The default is posix_spawn unless built with -DWISH_SPAWN_FORK; the WISH_SPAWN
+// environment variable ("posix" or "fork") overrides it at runtime.
+typedef enum {
+    SPAWN_POSIX,
+    SPAWN_FORK
+} SpawnMode;
+
+SpawnMode spawn_get_mode(void);
+void spawn_set_mode(SpawnMode mode);
+
+// Launches program with argv and the environment of env_block() (see env.h).
+// If redir_target is non-NULL, the child's stdout and stderr are
+// truncated/redirected to it. Returns the child pid, or -1 with errno set if
+// the child could not be started (including exec and redirect failures).
+pid_t spawn_command(const char *program, char *const argv[], const char *redir_target);
+
+// Like spawn_command, but stdin_fd, stdout_fd and stderr_fd (when not -1) are
+// installed as the child's stdin/stdout/stderr first, e.g. the ends of a
+// pipeline's pipes. A redir_target still takes precedence for stdout/stderr.
+// Placement follows the affinity policy (see affinity.h).
+pid_t spawn_command_fds(const char *program, char *const argv[], const char *redir_target,
+                        int stdin_fd, int stdout_fd, int stderr_fd);
+
+// Like spawn_command_fds, but pins the child to cpu (-1 inherits the caller's affinity)
+pid_t spawn_command_on(const char *program, char *const argv[], const char *redir_target,
+                       int stdin_fd, int stdout_fd, int stderr_fd, int cpu);
+
+#endif // SPAWN_H
@@ -0,0 +1,166 @@
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "utils.h"
+
+// Log-bucketed histogram of durations (nanoseconds): HIST_SUB buckets per
+// power of two, so a percentile is off by at most half a bucket (~6%), and a
+// series takes the same memory however long the session runs
+#define HIST_SUB_BITS 3
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((63 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct {
+    uint64_t buckets[HIST_BUCKETS];
+    uint64_t count;
+    long long max;
+} Histogram;
+
+// Per command name (argv[0]) totals
+typedef struct {
+    char *name;          // NULL marks an empty slot
+    uint64_t hash;
+    Histogram wall;
+    long long user_ns;
+    long long sys_ns;
+    long max_rss_kb;
+    long voluntary_cs;
+    long involuntary_cs;
+} CommandStats;
+
+static CommandStats *commands = NULL;
+static size_t command_cap = 0;
+static size_t command_count = 0;
+
+static Histogram spawn_times;
+static unsigned long lookups = 0;
+static long long lookup_total_ns = 0;
+
+// Values below 2 * HIST_SUB get a bucket each; above, HIST_SUB per octave
+static int bucket_of(long long v) {
+    if (v < HIST_SUB) return v < 0 ? 0 : (int)v;
+    int octave = 63 - __builtin_clzll((unsigned long long)v);
+    int sub = (int)((v >> (octave - HIST_SUB_BITS)) & (HIST_SUB - 1));
+    return (octave - HIST_SUB_BITS + 1) * HIST_SUB + sub;
+}
+
+// Middle of a bucket's range
+static long long bucket_value(int index) {
+    if (index < HIST_SUB) return index;
+    int shift = index / HIST_SUB - 1;
+    long long low = (long long)(HIST_SUB + index % HIST_SUB) << shift;
+    return low + ((1LL << shift) >> 1);
+}
+
+static void add_sample(Histogram *h, long long v) {
+    h->buckets[bucket_of(v)]++;
+    h->count++;
+    if (v > h->max) h->max = v;
+}
+
+// p-th percentile (nearest rank), never above the largest sample
+static long long percentile(const Histogram *h, double p) {
+    if (h->count == 0) return 0;
+    uint64_t rank = (uint64_t)(p / 100.0 * h->count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank >= h->count) return h->max;
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            long long v = bucket_value(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+static long long timeval_ns(struct timeval tv) {
+    return (long long)tv.tv_sec * 1000000000LL + (long long)tv.tv_usec * 1000LL;
+}
+
+static CommandStats *find_command(const char *name, uint64_t h) {
+    size_t mask = command_cap - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        if (!commands[i].name) return &commands[i];
+        if (commands[i].hash == h && strcmp(commands[i].name, name) == 0) return &commands[i];
+    }
+}
+
+static CommandStats *lookup_or_add(const char *name) {
+    if ((command_count + 1) * 4 > command_cap * 3) {
+        size_t new_cap = command_cap ? command_cap * 2 : 32;
+        CommandStats *old = commands;
+        size_t old_cap = command_cap;
+        commands = calloc(new_cap, sizeof(CommandStats));
+        if (!commands) {
+            commands = old;
+            return NULL;
+        }
+        command_cap = new_cap;
+        for (size_t i = 0; i < old_cap; i++) {
+            if (old[i].name) *find_command(old[i].name, old[i].hash) = old[i];
+        }
+        free(old);
+    }
+    uint64_t h = hash_string(name);
+    CommandStats *cs = find_command(name, h);
+    if (!cs->name) {
+        cs->name = strdup(name);
+        if (!cs->name) return NULL;
+        cs->hash = h;
+        command_count++;
+    }
+    return cs;
+}
+
+void stats_record_spawn(long long ns) {
+    add_sample(&spawn_times, ns);
+}
+
+void stats_record_lookup(long long ns) {
+    lookups++;
+    lookup_total_ns += ns;
+}
+
+void stats_record_exit(const char *name, long long wall_ns, const struct rusage *usage) {
+    CommandStats *cs = lookup_or_add(name);
+    if (!cs) return;
+    add_sample(&cs->wall, wall_ns);
+    cs->user_ns += timeval_ns(usage->ru_utime);
+    cs->sys_ns += timeval_ns(usage->ru_stime);
+    if (usage->ru_maxrss > cs->max_rss_kb) cs->max_rss_kb = usage->ru_maxrss;
+    cs->voluntary_cs += usage->ru_nvcsw;
+    cs->involuntary_cs += usage->ru_nivcsw;
+}
+
+void stats_print(void) {
+    printf("spawns: %lu  p50: %.1f us  p99: %.1f us\n", (unsigned long)spawn_times.count,
+           percentile(&spawn_times, 50) / 1e3, percentile(&spawn_times, 99) / 1e3);
+    printf("path lookups: %lu  avg: %.0f ns\n", lookups,
+           lookups ? (double)lookup_total_ns / lookups : 0.0);
+    printf("%-20s %7s %10s %10s %10s %10s %9s %9s %10s %8s\n", "command", "count", "p50 ms",
+           "p90 ms", "p99 ms", "max ms", "user s", "sys s", "maxrss KB", "ctxsw");
+    for (size_t i = 0; i < command_cap; i++) {
+        CommandStats *cs = &commands[i];
+        if (!cs->name) continue;
+        printf("%-20s %7lu %10.3f %10.3f %10.3f %10.3f %9.3f %9.3f %10ld %8ld\n", cs->name,
+               (unsigned long)cs->wall.count, percentile(&cs->wall, 50) / 1e6, percentile(&cs->wall, 90) / 1e6,
+               percentile(&cs->wall, 99) / 1e6, percentile(&cs->wall, 100) / 1e6,
+               cs->user_ns / 1e9, cs->sys_ns / 1e9, cs->max_rss_kb,
+               cs->voluntary_cs + cs->involuntary_cs);
+    }
+}
+
+void stats_reset(void) {
+    for (size_t i = 0; i < command_cap; i++) free(commands[i].name);
+    free(commands);
+    commands = NULL;
+    command_cap = 0;
+    command_count = 0;
+    memset(&spawn_times, 0, sizeof(spawn_times));
+    lookups = 0;
+    lookup_total_ns = 0;
+}
@@ -0,0 +1,23 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <sys/resource.h>
+
+// Session-wide resource accounting for the `stats` builtin
+
+// Time spent starting one child (fork/posix_spawn until the call returned)
+void stats_record_spawn(long long ns);
+
+// Time spent resolving one command name to an executable
+void stats_record_lookup(long long ns);
+
+// A child exited after wall_ns with the given wait4 usage
+void stats_record_exit(const char *name, long long wall_ns, const struct rusage *usage);
+
+// Prints aggregates: spawn/lookup costs and per-command percentiles. Durations
+// are kept in fixed-size log-bucketed histograms, so percentiles are within
+// about 6% and memory does not grow with the number of commands run.
+void stats_print(void);
+void stats_reset(void);
+
+#endif // STATS_H
@@ -0,0 +1,28 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Test helper: `argv_check N` expects exactly the arguments a0 .. a(N-1) and
+// prints "ok", or what differs, so the shell's argv handling can be checked
+// from a script.
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        printf("usage: argv_check N a0 a1 ...\n");
+        return 2;
+    }
+    long expected = atol(argv[1]);
+    if (argc - 2 != expected) {
+        printf("bad count: %d, expected %ld\n", argc - 2, expected);
+        return 1;
+    }
+    char want[32];
+    for (long i = 0; i < expected; i++) {
+        snprintf(want, sizeof(want), "a%ld", i);
+        if (strcmp(argv[i + 2], want) != 0) {
+            printf("bad argument %ld: '%s', expected '%s'\n", i, argv[i + 2], want);
+            return 1;
+        }
+    }
+    printf("ok\n");
+    return 0;
+}
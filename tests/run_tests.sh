@@ -0,0 +1,285 @@
+#!/bin/sh
+# Regression tests for `make check`. Each case runs a script through wish and
+# compares its output with what is expected; the exit status is non-zero if
+# any case fails.
+
+WISH=${WISH:-./wish}
+TESTS=$(cd "$(dirname "$0")" && pwd)
+WORK=$(mktemp -d /tmp/wish-test-XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+# Nothing a test runs may write to the user's own cache
+export XDG_CACHE_HOME="$WORK/cache"
+failures=0
+
+pass() {
+    echo "PASS: $1"
+}
+
+fail() {
+    echo "FAIL: $1"
+    failures=$((failures + 1))
+}
+
+# check NAME EXPECTED: runs the script in $WORK/script and compares its stdout
+check() {
+    actual=$(timeout -s KILL 60 "$WISH" "$WORK/script" 2>"$WORK/stderr")
+    if [ "$actual" = "$2" ]; then
+        pass "$1"
+    else
+        fail "$1"
+        echo "  expected: $(printf '%s' "$2" | head -c 300)"
+        echo "  actual:   $(printf '%s' "$actual" | head -c 300)"
+        sed 's/^/  stderr:   /' "$WORK/stderr" | head -5
+    fi
+}
+
+# ----------------- Wide lines (no fixed limits) -----------------
+
+# One command with 100k arguments; the child must receive every one in order
+{
+    printf '%s/argv_check 100000' "$TESTS"
+    i=0
+    while [ $i -lt 100000 ]; do
+        printf ' a%d' $i
+        i=$((i + 1))
+    done
+    printf '\n'
+} > "$WORK/script"
+check "100k arguments reach the child intact" "ok"
+
+# 10k parallel commands on one line, each with its own arguments
+{
+    i=0
+    while [ $i -lt 10000 ]; do
+        [ $i -gt 0 ] && printf ' & '
+        printf '%s/argv_check 3 a0 a1 a2 > %s/out%d' "$TESTS" "$WORK" $i
+        i=$((i + 1))
+    done
+    printf '\n'
+} > "$WORK/script"
+"$WISH" "$WORK/script" 2>"$WORK/stderr"
+oks=$(cat "$WORK"/out* 2>/dev/null | grep -c '^ok$')
+if [ "$oks" = 10000 ]; then
+    pass "10k-way parallel line runs every command"
+else
+    fail "10k-way parallel line runs every command ($oks of 10000)"
+fi
+rm -f "$WORK"/out*
+
+# ----------------- Working directory of launched programs -----------------
+
+mkdir -p "$WORK/cwd/sub"
+printf 'cd %s/cwd\n/bin/pwd\ncd sub\n/bin/pwd\n/bin/ls ../\n' "$WORK" > "$WORK/script"
+for zygote in off on; do
+    WISH_ZYGOTE=$zygote check "cd then launch (zygote $zygote)" "$WORK/cwd
+$WORK/cwd/sub
+sub"
+done
+
+# ----------------- Program lookup cache -----------------
+
+# A program installed (or made executable) by an earlier line is found at once
+mkdir -p "$WORK/pc"
+printf '#!/bin/sh\necho found\n' > "$WORK/newcmd.src"
+printf '#!/bin/sh\necho made-executable\n' > "$WORK/pc/later"
+cat > "$WORK/script" <<SCRIPT
+path $WORK/pc /bin /usr/bin
+newcmd
+cp $WORK/newcmd.src $WORK/pc/newcmd
+chmod +x $WORK/pc/newcmd
+newcmd
+later
+chmod +x $WORK/pc/later
+later
+SCRIPT
+check "newly installed programs are found without waiting" "found
+made-executable"
+
+# ----------------- In-process utilities -----------------
+
+# A program called echo earlier on the path is run, not replaced
+mkdir -p "$WORK/mybin"
+printf '#!/bin/sh\necho CUSTOM "$@"\n' > "$WORK/mybin/echo"
+chmod +x "$WORK/mybin/echo"
+printf 'path %s/mybin /bin\necho hi\npath /bin\necho hi\n' "$WORK" > "$WORK/script"
+check "a user's echo on the path is not replaced" "CUSTOM hi
+hi"
+
+# The commands of an `&` line run as parallel children, not one by one in the shell
+printf 'echo a > %s/par.1 & echo b > %s/par.2\ninproc\n' "$WORK" "$WORK" > "$WORK/script"
+check "an & line runs no command in-process" "inproc: on saved launches: 0"
+
+# cat of a FIFO runs as a child, so the writer later on the line can start
+mkfifo "$WORK/fifo"
+printf 'jobs -j 0\ncat %s/fifo > %s/fifo.out & echo through-fifo > %s/fifo\ncat %s/fifo.out\n' \
+    "$WORK" "$WORK" "$WORK" "$WORK" > "$WORK/script"
+check "cat of a FIFO does not block the shell" "through-fifo"
+pkill -f "$WORK/fifo" 2>/dev/null
+
+# ----------------- Pipelines -----------------
+
+# A redirected pipeline ending in tee FILE fills both files
+printf 'seq 1 3 | tee %s/tee.copy > %s/tee.out\ncat %s/tee.copy %s/tee.out\n' \
+    "$WORK" "$WORK" "$WORK" "$WORK" > "$WORK/script"
+check "a pipeline into tee FILE writes both files" "1
+2
+3
+1
+2
+3"
+
+# A user's cat at the end of a pipeline runs; only the system's is replaced
+mkdir -p "$WORK/catbin"
+printf '#!/bin/sh\necho CUSTOM-CAT\n' > "$WORK/catbin/cat"
+chmod +x "$WORK/catbin/cat"
+printf 'path %s/catbin /bin /usr/bin\nseq 1 3 | cat > %s/cat.out\n/bin/cat %s/cat.out\n' \
+    "$WORK" "$WORK" "$WORK" > "$WORK/script"
+check "a user's cat at a pipeline's end is not replaced" "CUSTOM-CAT"
+
+# ----------------- Collated output -----------------
+
+# stderr stays on stderr when output is collated
+printf 'echo to-out\necho to-err >&2\n' > "$WORK/both.sh"
+printf 'collate on\n/bin/sh %s/both.sh & /bin/sh %s/both.sh\n' "$WORK" "$WORK" > "$WORK/script"
+check "collated stderr is not replayed on stdout" "to-out
+to-out"
+if [ "$(cat "$WORK/stderr")" = "to-err
+to-err" ]; then
+    pass "collated stderr is replayed on stderr"
+else
+    fail "collated stderr is replayed on stderr"
+fi
+
+# A background process left holding the capture pipe does not stall the shell
+printf 'sleep 10 &\necho started\n' > "$WORK/bg.sh"
+printf 'collate on\n/bin/sh %s/bg.sh\necho after\n' "$WORK" > "$WORK/script"
+start=$(date +%s%N)
+check "a job's leftover background process does not hold up the next line" "started
+after"
+elapsed_ms=$(( ($(date +%s%N) - start) / 1000000 ))
+if [ $elapsed_ms -lt 5000 ]; then
+    pass "collation does not wait for a job's background processes"
+else
+    fail "collation does not wait for a job's background processes"
+    echo "  took ${elapsed_ms}ms"
+fi
+
+# ----------------- Scheduling -----------------
+
+# A command waiting on a DAG dependency does not hold up later lines, including
+# ones the plan cache cannot take (the pattern expands to the file "2")
+mkdir -p "$WORK/dag"
+touch "$WORK/dag/2"
+printf 'cd %s/dag\njobs -j 8\ndag on\n[a] sleep 2\n[b:a] echo b\nsleep 2*\necho end\n' "$WORK" > "$WORK/script"
+start=$(date +%s%N)
+timeout -s KILL 60 "$WISH" "$WORK/script" >/dev/null 2>&1
+elapsed_ms=$(( ($(date +%s%N) - start) / 1000000 ))
+if [ $elapsed_ms -lt 3500 ]; then
+    pass "lines after a dependent command run alongside it"
+else
+    fail "lines after a dependent command run alongside it"
+    echo "  took ${elapsed_ms}ms, expected about 2000ms"
+fi
+
+# ----------------- Compiled scripts -----------------
+
+# Scripts are only compiled into the cache when asked to
+printf 'echo plain-run\n' > "$WORK/script"
+check "a plain script runs from its text" "plain-run"
+if [ -z "$(ls "$WORK/cache/wish" 2>/dev/null)" ]; then
+    pass "a plain script run leaves nothing in the cache"
+else
+    fail "a plain script run leaves nothing in the cache"
+fi
+
+# A sidecar whose records were altered after compiling is not run
+printf 'echo real-output\n' > "$WORK/script"
+"$WISH" --compile "$WORK/script"
+sed -i 's/real-output/forged-outp/' "$WORK/script.wishc"
+check "an altered compiled script is not run" "real-output"
+
+# A sidecar others can write is not trusted: the script is compiled afresh
+# into the cache, whose directory is made private
+mkdir -m 755 -p "$WORK/cache/wish"
+"$WISH" --compile "$WORK/script"
+chmod g+w "$WORK/script.wishc"
+export WISH_BATCH_CACHE=on
+check "a group-writable compiled script is not run" "real-output"
+unset WISH_BATCH_CACHE
+if ls "$WORK/cache/wish"/*.wishc >/dev/null 2>&1 && [ "$(stat -c %a "$WORK/cache/wish")" = 700 ]; then
+    pass "the script cache is private"
+else
+    fail "the script cache is private"
+    ls -la "$WORK/cache/wish" | sed 's/^/  /'
+fi
+rm -f "$WORK/script.wishc"
+
+# A builtin on a labelled line runs after the line's dependencies
+printf 'dag on\n[mk] mkdir %s/made\n[go:mk] cd %s/made\n/bin/pwd\n' "$WORK" "$WORK" > "$WORK/script"
+check "a builtin waits for its line's dependencies" "$WORK/made"
+
+# ----------------- Command server -----------------
+
+"$WISH" --serve "$WORK/sock" >"$WORK/server.out" 2>"$WORK/server.err" &
+server=$!
+i=0
+while [ ! -S "$WORK/sock" ] && [ $i -lt 100 ]; do
+    sleep 0.05
+    i=$((i + 1))
+done
+
+# A timed request reports on the client's stderr, not the server's
+"$WISH" --client "$WORK/sock" "time /bin/true" 2>"$WORK/time.err"
+if grep -q '^real ' "$WORK/time.err" && ! grep -q '^real ' "$WORK/server.err"; then
+    pass "a server request's time report goes to its client"
+else
+    fail "a server request's time report goes to its client"
+fi
+
+# One client's long request does not hold up another's wait or cd
+"$WISH" --client "$WORK/sock" "jobs -j 1"
+"$WISH" --client "$WORK/sock" "/bin/sleep 3 & /bin/sleep 3" &
+client=$!
+sleep 0.3
+start=$(date +%s%N)
+"$WISH" --client "$WORK/sock" "wait"
+"$WISH" --client "$WORK/sock" "cd /"
+elapsed_ms=$(( ($(date +%s%N) - start) / 1000000 ))
+if [ $elapsed_ms -lt 1500 ]; then
+    pass "a client's wait and cd do not block on other clients"
+else
+    fail "a client's wait and cd do not block on other clients"
+    echo "  took ${elapsed_ms}ms"
+fi
+wait $client
+
+# A client that is slow to read its output does not hold up other clients,
+# and the shell's own output for a request still reaches its client
+head -c 2000000 /dev/zero > "$WORK/big"
+"$WISH" --client "$WORK/sock" "jobs -j 8"
+"$WISH" --client "$WORK/sock" "cat $WORK/big" | sleep 3 &
+slow=$!
+sleep 0.3
+start=$(date +%s%N)
+fast=$(timeout -s KILL 2 "$WISH" --client "$WORK/sock" "echo x")
+elapsed_ms=$(( ($(date +%s%N) - start) / 1000000 ))
+if [ "$fast" = x ] && [ $elapsed_ms -lt 1500 ]; then
+    pass "a slow client does not block the server"
+else
+    fail "a slow client does not block the server"
+    echo "  took ${elapsed_ms}ms"
+fi
+if timeout -s KILL 2 "$WISH" --client "$WORK/sock" "jobs" | grep -q .; then
+    pass "builtin output reaches the client"
+else
+    fail "builtin output reaches the client"
+fi
+wait $slow
+kill $server
+wait $server 2>/dev/null
+
+if [ $failures -gt 0 ]; then
+    echo "$failures test(s) failed"
+    exit 1
+fi
+echo "all tests passed"
@@ -0,0 +1,152 @@
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include "wish.h"
+
+// Ring capacity in events (a power of two); about 5 MB while tracing
+#define TRACE_RING_EVENTS (1 << 16)
+#define TRACE_DETAIL_LEN 48
+
+typedef struct {
+    int kind;
+    pid_t tid;
+    long long start_ns;
+    long long end_ns;
+    char detail[TRACE_DETAIL_LEN];
+} TraceEvent;
+
+int trace_active = 0;
+
+static TraceEvent *ring = NULL;
+static atomic_ulong next_event;  // total events recorded; slot = next_event % capacity
+static long long epoch_ns = 0;   // trace timestamps are relative to trace_start
+static char *out_path = NULL;
+static pid_t shell_pid = 0;
+static int atexit_registered = 0;
+
+static const char *kind_names[] = {
+    [TRACE_READ] = "read",
+    [TRACE_PARSE] = "parse",
+    [TRACE_RESOLVE] = "resolve",
+    [TRACE_SPAWN] = "spawn",
+    [TRACE_EXEC_FAILED] = "exec-failed",
+    [TRACE_REAP] = "reap",
+};
+
+void trace_span(TraceKind kind, long long start_ns, long long end_ns, pid_t tid, const char *detail) {
+    if (!trace_active) return;
+    // Claiming a slot is a single atomic add, so helper threads may record too
+    unsigned long n = atomic_fetch_add_explicit(&next_event, 1, memory_order_relaxed);
+    TraceEvent *ev = &ring[n & (TRACE_RING_EVENTS - 1)];
+    ev->kind = kind;
+    ev->tid = tid;
+    ev->start_ns = start_ns;
+    ev->end_ns = end_ns;
+    if (detail) {
+        strncpy(ev->detail, detail, TRACE_DETAIL_LEN - 1);
+        ev->detail[TRACE_DETAIL_LEN - 1] = '\0';
+    } else {
+        ev->detail[0] = '\0';
+    }
+}
+
+void trace_end(TraceKind kind, long long start, const char *detail) {
+    if (!start || !trace_active) return; // tracing was off when the span began
+    trace_span(kind, start, monotonic_now_ns(), shell_pid, detail);
+}
+
+static void write_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if (c < 0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+static int write_trace(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    unsigned long total = atomic_load(&next_event);
+    unsigned long count = total < TRACE_RING_EVENTS ? total : TRACE_RING_EVENTS;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"wish\"}}",
+            (int)shell_pid);
+    for (unsigned long n = total - count; n < total; n++) {
+        const TraceEvent *ev = &ring[n & (TRACE_RING_EVENTS - 1)];
+        double ts = (ev->start_ns - epoch_ns) / 1e3;
+        fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"wish\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f",
+                kind_names[ev->kind], (int)shell_pid, (int)ev->tid, ts);
+        if (ev->kind == TRACE_EXEC_FAILED) {
+            fprintf(f, ",\"ph\":\"i\",\"s\":\"t\"");
+        } else {
+            fprintf(f, ",\"ph\":\"X\",\"dur\":%.3f", (ev->end_ns - ev->start_ns) / 1e3);
+        }
+        if (ev->detail[0]) {
+            fprintf(f, ",\"args\":{\"detail\":");
+            write_json_string(f, ev->detail);
+            fputc('}', f);
+        }
+        fputc('}', f);
+    }
+    fprintf(f, "\n]}\n");
+    if (total > count) {
+        fprintf(stderr, "trace: ring overflowed, kept the last %lu of %lu events\n", count, total);
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+static void trace_at_exit(void) {
+    // Only the shell itself writes the trace, never a forked child on its way out
+    if (trace_active && getpid() == shell_pid) trace_stop();
+}
+
+int trace_start(const char *path) {
+    if (trace_active && trace_stop() != 0) return -1;
+    char *copy = strdup(path);
+    if (!copy) return -1;
+    if (!ring) {
+        ring = malloc(sizeof(TraceEvent) * TRACE_RING_EVENTS);
+        if (!ring) {
+            free(copy);
+            return -1;
+        }
+    }
+    free(out_path);
+    out_path = copy;
+    atomic_store(&next_event, 0);
+    shell_pid = getpid();
+    epoch_ns = monotonic_now_ns();
+    if (!atexit_registered) {
+        atexit(trace_at_exit);
+        atexit_registered = 1;
+    }
+    trace_active = 1;
+    return 0;
+}
+
+int trace_stop(void) {
+    if (!trace_active) {
+        errno = EINVAL;
+        return -1;
+    }
+    trace_active = 0;
+    int ret = write_trace(out_path);
+    free(ring);
+    ring = NULL;
+    return ret;
+}
+
+void trace_init_from_env(void) {
+    const char *path = getenv("WISH_TRACE");
+    if (path && *path && trace_start(path) != 0) {
+        print_errno();
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <sys/types.h>
+#include "utils.h"
+
+// Span tracer for finding where a batch run spends its time. Events go into a
+// fixed-size in-memory ring (the oldest are overwritten) and are written out as
+// Chrome trace-event JSON, which Perfetto and chrome://tracing can load.
+// Enabled with the `trace on <file>` builtin or WISH_TRACE=<file>.
+
+typedef enum {
+    TRACE_READ,        // reading the next input line
+    TRACE_PARSE,       // parsing one line
+    TRACE_RESOLVE,     // looking a command name up in the search path
+    TRACE_SPAWN,       // starting one child
+    TRACE_EXEC_FAILED, // a child could not be started (instant)
+    TRACE_REAP,        // a child's lifetime, from spawn until it was reaped
+} TraceKind;
+
+extern int trace_active;
+
+// Start timestamp for a span, or 0 when tracing is off (so a disabled tracer
+// costs one predictable branch per call site)
+static inline long long trace_begin(void) {
+    return trace_active ? monotonic_now_ns() : 0;
+}
+
+// Records a span that started at `start` (from trace_begin) and ends now.
+// detail may be NULL; it is truncated to fit the ring slot.
+void trace_end(TraceKind kind, long long start, const char *detail);
+
+// Records a span with explicit bounds, shown on the track of `tid`
+void trace_span(TraceKind kind, long long start_ns, long long end_ns, pid_t tid, const char *detail);
+
+// Starts recording into a fresh ring; the trace is written to path by
+// trace_stop() or at exit. Returns 0, or -1 with errno set.
+int trace_start(const char *path);
+
+// Writes the recorded events to the file given to trace_start and stops
+// recording. Returns 0, or -1 with errno set.
+int trace_stop(void);
+
+// Enables tracing if WISH_TRACE names an output file
+void trace_init_from_env(void);
+
+#endif // TRACE_H
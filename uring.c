@@ -0,0 +1,379 @@
+#define _GNU_SOURCE
+#include "uring.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES 256
+#define URING_READ_CHUNK (64 * 1024)
+#define URING_READ_MIN 4096 // grow the input buffer when less than this is free
+
+// user_data carries the request kind in its top byte
+enum { KIND_POLL = 1, KIND_READ, KIND_WRITE };
+#define MAKE_TAG(kind, value) (((uint64_t)(kind) << 56) | (uint64_t)(value))
+#define TAG_KIND(tag) ((int)((tag) >> 56))
+#define TAG_VALUE(tag) ((tag) & ((1ULL << 56) - 1))
+
+static bool active = false;
+static int ring_fd = -1;
+
+static unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+static unsigned *cq_head, *cq_tail, *cq_mask;
+static struct io_uring_sqe *sqes;
+static struct io_uring_cqe *cqes;
+static unsigned sq_entries;
+static unsigned sq_local_tail;
+static unsigned to_submit = 0; // filled in but not yet passed to the kernel
+
+// Fired poll tags not yet handed out by uring_next_poll
+static uint64_t *fired = NULL;
+static int fired_head = 0;
+static int fired_count = 0;
+static int fired_cap = 0;
+
+// One block per uring_write, freed when its completion arrives
+typedef struct {
+    int fd;
+    size_t len;
+    char data[];
+} WriteBlock;
+
+static struct io_uring_sqe *last_write = NULL; // unsubmitted write the next one links after
+static int writes_outstanding = 0;
+
+static struct {
+    int fd;
+    char *buf;
+    size_t cap;
+    size_t start;   // unread data is [start, end)
+    size_t end;
+    bool tty;
+    bool inflight;
+    bool eof;
+    int error;      // errno of a failed read, reported by the next uring_getline
+} input = { -1, NULL, 0, 0, 0, false, false, false, 0 };
+
+bool uring_active(void) {
+    return active;
+}
+
+int uring_fd(void) {
+    return ring_fd;
+}
+
+/* ----------------- Ring ----------------- */
+
+static int setup_ring(void) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (fd < 0) return -1;
+    // Reads and writes at the file position, waits with a timeout, and no
+    // dropped completions when the CQ fills up
+    unsigned needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_RW_CUR_POS |
+                      IORING_FEAT_EXT_ARG | IORING_FEAT_NODROP;
+    if ((p.features & needed) != needed) {
+        close(fd);
+        errno = ENOSYS;
+        return -1;
+    }
+    size_t sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    size_t ring_len = sq_len > cq_len ? sq_len : cq_len;
+    char *ring = mmap(NULL, ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        munmap(ring, ring_len);
+        close(fd);
+        return -1;
+    }
+    sq_head = (unsigned *)(ring + p.sq_off.head);
+    sq_tail = (unsigned *)(ring + p.sq_off.tail);
+    sq_mask = (unsigned *)(ring + p.sq_off.ring_mask);
+    sq_array = (unsigned *)(ring + p.sq_off.array);
+    cq_head = (unsigned *)(ring + p.cq_off.head);
+    cq_tail = (unsigned *)(ring + p.cq_off.tail);
+    cq_mask = (unsigned *)(ring + p.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+    sq_entries = p.sq_entries;
+    sq_local_tail = *sq_tail;
+    ring_fd = fd;
+    return 0;
+}
+
+// Submits the queued requests and, if min_complete > 0, waits up to timeout_ms
+// (-1 = forever) for that many completions. Returns -1 with errno set on failure
+// (ETIME on timeout).
+static int enter(unsigned min_complete, int timeout_ms) {
+    if (min_complete == 0 && to_submit == 0) return 0;
+    unsigned flags = 0;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    void *argp = NULL;
+    size_t arg_size = 0;
+    if (min_complete > 0) {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+            memset(&arg, 0, sizeof(arg));
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            arg_size = sizeof(arg);
+        }
+    }
+    int n = (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, argp, arg_size);
+    if (n < 0) return -1;
+    to_submit -= (unsigned)n;
+    if (to_submit == 0) last_write = NULL;
+    return 0;
+}
+
+static bool sq_full(void) {
+    return sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries;
+}
+
+static struct io_uring_sqe *get_sqe(void) {
+    if (sq_full()) {
+        if (enter(0, -1) != 0) return NULL;
+        if (sq_full()) {
+            errno = EBUSY;
+            return NULL;
+        }
+    }
+    unsigned idx = sq_local_tail & *sq_mask;
+    struct io_uring_sqe *sqe = &sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[idx] = idx;
+    sq_local_tail++;
+    // The kernel only looks at the SQ during io_uring_enter, so the entry may
+    // still be filled in (or linked) after the tail moves
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+    to_submit++;
+    return sqe;
+}
+
+static void write_rest(const WriteBlock *b, size_t done) {
+    while (done < b->len) {
+        ssize_t w = write(b->fd, b->data + done, b->len - done);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        done += (size_t)w;
+    }
+}
+
+static void complete(uint64_t tag, int res) {
+    switch (TAG_KIND(tag)) {
+        case KIND_POLL:
+            if (fired_count >= fired_cap) {
+                int new_cap = fired_cap ? fired_cap * 2 : 64;
+                uint64_t *new_fired = realloc(fired, sizeof(uint64_t) * new_cap);
+                if (!new_fired) return;
+                fired = new_fired;
+                fired_cap = new_cap;
+            }
+            // Errors are reported too: the owner finds out what happened itself
+            fired[fired_count++] = TAG_VALUE(tag);
+            break;
+        case KIND_READ:
+            input.inflight = false;
+            if (res > 0) input.end += (size_t)res;
+            else if (res == 0) input.eof = true;
+            else if (res != -EINTR && res != -EAGAIN) input.error = -res;
+            break;
+        case KIND_WRITE: {
+            WriteBlock *b = (WriteBlock *)(uintptr_t)TAG_VALUE(tag);
+            // Short writes and writes cancelled behind a failed one finish here
+            if (res >= 0) write_rest(b, (size_t)res);
+            else if (res == -ECANCELED) write_rest(b, 0);
+            free(b);
+            writes_outstanding--;
+            break;
+        }
+    }
+}
+
+// Handles every completion posted so far (no syscall)
+static void harvest(void) {
+    unsigned head = *cq_head;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+        complete(cqe->user_data, cqe->res);
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+}
+
+// Waits until every submitted write has completed
+static void wait_for_writes(void) {
+    harvest();
+    while (writes_outstanding > 0) {
+        if (enter(1, -1) != 0 && errno != EINTR) return;
+        harvest();
+    }
+}
+
+void uring_flush(void) {
+    if (!active) return;
+    enter(0, -1);
+    wait_for_writes();
+}
+
+void uring_init_from_env(void) {
+    const char *env = getenv("WISH_URING");
+    if (!env || strcmp(env, "on") != 0 || active) return;
+    if (setup_ring() != 0) return; // no io_uring here: stay on the epoll path
+    active = true;
+    atexit(uring_flush);
+}
+
+/* ----------------- Polls ----------------- */
+
+int uring_poll_add(int fd, uint64_t tag) {
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe) return -1;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = MAKE_TAG(KIND_POLL, tag);
+    return 0;
+}
+
+int uring_next_poll(uint64_t *tag, int timeout_ms) {
+    while (1) {
+        harvest();
+        if (fired_head < fired_count) {
+            *tag = fired[fired_head++];
+            if (fired_head == fired_count) fired_head = fired_count = 0;
+            return 1;
+        }
+        if (timeout_ms == 0) {
+            // Queued output and read-ahead still go out with this call
+            if (enter(0, -1) != 0) return -1;
+            harvest();
+            if (fired_head == fired_count) return 0;
+            continue;
+        }
+        if (enter(1, timeout_ms) != 0) {
+            if (errno == EINTR) continue;
+            return errno == ETIME ? 0 : -1;
+        }
+    }
+}
+
+/* ----------------- Input ----------------- */
+
+// Queues a read into the free end of the input buffer. Only called with no
+// read in flight, so the buffer may be compacted or grown first.
+static int request_read(void) {
+    if (input.start > 0) {
+        memmove(input.buf, input.buf + input.start, input.end - input.start);
+        input.end -= input.start;
+        input.start = 0;
+    }
+    if (input.cap - input.end < URING_READ_MIN) {
+        char *new_buf = realloc(input.buf, input.cap * 2);
+        if (!new_buf) return -1;
+        input.buf = new_buf;
+        input.cap *= 2;
+    }
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe) return -1;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = input.fd;
+    sqe->addr = (uint64_t)(uintptr_t)(input.buf + input.end);
+    sqe->len = (unsigned)(input.cap - input.end);
+    sqe->off = (uint64_t)-1; // current file position
+    sqe->user_data = MAKE_TAG(KIND_READ, 0);
+    input.inflight = true;
+    return 0;
+}
+
+bool uring_input_eof(void) {
+    return input.eof && input.start == input.end;
+}
+
+ssize_t uring_getline(char **line, size_t *cap, int fd) {
+    if (!input.buf) {
+        input.buf = malloc(URING_READ_CHUNK);
+        if (!input.buf) return -1;
+        input.cap = URING_READ_CHUNK;
+        input.fd = fd;
+        input.tty = isatty(fd);
+    }
+    while (1) {
+        size_t avail = input.end - input.start;
+        char *nl = memchr(input.buf + input.start, '\n', avail);
+        if (nl || (input.eof && avail > 0)) {
+            size_t n = nl ? (size_t)(nl + 1 - (input.buf + input.start)) : avail;
+            if (*cap < n + 1) {
+                char *new_line = realloc(*line, n + 1);
+                if (!new_line) return -1;
+                *line = new_line;
+                *cap = n + 1;
+            }
+            memcpy(*line, input.buf + input.start, n);
+            (*line)[n] = '\0';
+            input.start += n;
+            // Read ahead while the line runs; it is submitted with the next ring call
+            if (!input.tty && !input.inflight && !input.eof && input.start == input.end) {
+                request_read();
+            }
+            return (ssize_t)n;
+        }
+        if (input.eof) return -1;
+        if (input.error) {
+            errno = input.error;
+            input.error = 0;
+            return -1;
+        }
+        if (!input.inflight && request_read() != 0) return -1;
+        while (input.inflight) {
+            if (enter(1, -1) != 0 && errno != EINTR) return -1;
+            harvest();
+        }
+    }
+}
+
+/* ----------------- Output ----------------- */
+
+int uring_write(int fd, const void *buf, size_t len) {
+    if (sq_full()) enter(0, -1);
+    // A new chain starts only after the previous one has finished, so output
+    // keeps its order even when the kernel completes a write asynchronously
+    if (!last_write) wait_for_writes();
+    WriteBlock *b = malloc(sizeof(WriteBlock) + len);
+    if (!b) return -1;
+    b->fd = fd;
+    b->len = len;
+    memcpy(b->data, buf, len);
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe) {
+        free(b);
+        return -1;
+    }
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)b->data;
+    sqe->len = (unsigned)len;
+    sqe->off = (uint64_t)-1;
+    sqe->user_data = MAKE_TAG(KIND_WRITE, (uintptr_t)b);
+    if (last_write) last_write->flags |= IOSQE_IO_LINK;
+    last_write = sqe;
+    writes_outstanding++;
+    return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Optional io_uring event core, driven through the raw syscalls. One ring
+// carries the shell's input reads (with read-ahead), its prompt and error
+// output, and poll requests on child pidfds, so a single io_uring_enter can
+// submit queued output and the next read while waiting for children. Enabled
+// with WISH_URING=on; kernels without io_uring (or the features used here)
+// keep the epoll reaper and plain reads and writes.
+
+// Sets up the ring if WISH_URING=on. Call once, after the zygote has been forked.
+void uring_init_from_env(void);
+
+bool uring_active(void);
+
+// The ring descriptor, readable while completions are waiting (or -1)
+int uring_fd(void);
+
+/* ----------------- Polls (used by the reaper) ----------------- */
+
+// Queues a one-shot POLLIN request on fd, reported through uring_next_poll with
+// tag. tag must fit in 56 bits. Returns 0, or -1 with errno set.
+int uring_poll_add(int fd, uint64_t tag);
+
+// Waits up to timeout_ms (-1 = forever) for a poll request to fire. Returns 1
+// and fills tag, 0 on timeout, or -1 with errno set.
+int uring_next_poll(uint64_t *tag, int timeout_ms);
+
+/* ----------------- Input and output ----------------- */
+
+// Like getline on fd, through the ring. Unless fd is a terminal (where a
+// pending read would take input meant for a child) the next chunk is requested
+// as soon as the buffered one runs out. Returns -1 at end of input or on error.
+ssize_t uring_getline(char **line, size_t *cap, int fd);
+
+// True once uring_getline has returned -1 because the input ended
+bool uring_input_eof(void);
+
+// Queues a copy of buf for writing to fd after any earlier queued output. It
+// goes out with the next submission (uring_flush, or any wait on the ring).
+// Returns 0, or -1 with errno set.
+int uring_write(int fd, const void *buf, size_t len);
+
+// Submits whatever has been queued and waits until the queued output has been
+// written. Call before anything writes to the same descriptors directly.
+void uring_flush(void);
+
+#endif // URING_H
@@ -3,6 +3,8 @@
 #include <ctype.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+#include <sys/stat.h>
 
 char *trim_whitespace(char *s) {
     if (!s) return s;
@@ -18,3 +20,45 @@ void clear_stdin_buffer() {
     int c;
     while ((c = getchar()) != '\n' && c != EOF) {}
 }
+
+uint64_t hash_string(const char *s) {
+    uint64_t h = 1469598103934665603ULL;
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+uint64_t hash_bytes(const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+long long monotonic_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+bool is_system_program(const char *program, const char *name) {
+    static const char *const dirs[] = { "/bin/", "/usr/bin/" };
+    char path[64];
+    for (int d = 0; d < 2; d++) {
+        snprintf(path, sizeof(path), "%s%s", dirs[d], name);
+        if (strcmp(program, path) == 0) return true;
+    }
+    // Reached through another name, e.g. a symlinked directory on the path
+    struct stat st, sys;
+    if (stat(program, &st) != 0) return false;
+    for (int d = 0; d < 2; d++) {
+        snprintf(path, sizeof(path), "%s%s", dirs[d], name);
+        if (stat(path, &sys) == 0 && st.st_dev == sys.st_dev && st.st_ino == sys.st_ino) return true;
+    }
+    return false;
+}
@@ -1,7 +1,23 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 char *trim_whitespace(char *s);
 void clear_stdin_buffer();
 
+// 64-bit FNV-1a hash of a NUL-terminated string
+uint64_t hash_string(const char *s);
+uint64_t hash_bytes(const void *data, size_t len);
+
+// CLOCK_MONOTONIC in nanoseconds
+long long monotonic_now_ns(void);
+
+// True if program is the system's own copy of the utility name (/bin/name or
+// /usr/bin/name, by path or by device and inode), not some other program of
+// the same name that the search path found first
+bool is_system_program(const char *program, const char *name);
+
 #endif // UTILS_H
@@ -0,0 +1,498 @@
+#define _GNU_SOURCE // For fstatat flags
+#include "wildcard.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "arena.h"
+
+#define DIRENT_BUFFER_SIZE (256 * 1024)
+
+// The kernel's record for getdents64
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// One pattern component compiled into steps
+enum { STEP_LITERAL, STEP_ANY, STEP_STAR, STEP_CLASS };
+
+typedef struct {
+    int kind;
+    const char *text;  // STEP_LITERAL: the characters to match
+    size_t len;
+    uint8_t set[32];   // STEP_CLASS: bitmap of accepted bytes
+} Step;
+
+typedef struct {
+    Step *steps;
+    int count;
+    int cap;
+    bool dot_ok;       // the component itself starts with '.', so hidden names may match
+    const char *suffix; // literal text every match must end with, after the last '*'
+    size_t suffix_len;
+} Matcher;
+
+typedef struct {
+    uint32_t name;     // offset into the listing's names
+    uint32_t len;
+    unsigned char type; // d_type, DT_UNKNOWN if the file system gave none
+} ListingEntry;
+
+// A directory's entries, read once per line
+typedef struct {
+    char *path;
+    char *names;
+    size_t names_len;
+    ListingEntry *entries;
+    size_t count;
+    int dir_fd;        // kept open for stat calls, -1 if the directory could not be opened
+    int error;         // errno if the directory could not be read
+} Listing;
+
+typedef struct {
+    char **items;
+    size_t count;
+    size_t cap;
+} Results;
+
+static int enabled = -1; // -1 until read from WISH_GLOB
+
+static Arena glob_arena;     // expanded words and argv vectors, until the next line
+static Listing *listings = NULL;
+static int listing_count = 0;
+static int listing_cap = 0;
+static char *dirent_buffer = NULL;
+
+bool wildcard_enabled(void) {
+    if (enabled < 0) {
+        const char *env = getenv("WISH_GLOB");
+        enabled = !env || strcmp(env, "off") != 0;
+    }
+    return enabled;
+}
+
+// Length of the bracket expression opening at p, or 0 if it is not closed
+// (and so the '[' is an ordinary character)
+static size_t class_length(const char *p, size_t len) {
+    size_t i = 1;
+    if (i < len && (p[i] == '!' || p[i] == '^')) i++;
+    if (i < len && p[i] == ']') i++; // a leading ']' is a member
+    while (i < len && p[i] != ']') i++;
+    return i < len ? i + 1 : 0;
+}
+
+static bool is_pattern_n(const char *p, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (p[i] == '*' || p[i] == '?') return true;
+        if (p[i] == '[' && class_length(p + i, len - i) > 0) return true;
+    }
+    return false;
+}
+
+bool wildcard_is_pattern(const char *word) {
+    return is_pattern_n(word, strlen(word));
+}
+
+/* ----------------- Matching ----------------- */
+
+static Step *add_step(Matcher *m, int kind) {
+    if (m->count >= m->cap) {
+        int new_cap = m->cap ? m->cap * 2 : 8;
+        Step *p = realloc(m->steps, sizeof(Step) * new_cap);
+        if (!p) return NULL;
+        m->steps = p;
+        m->cap = new_cap;
+    }
+    Step *s = &m->steps[m->count++];
+    s->kind = kind;
+    return s;
+}
+
+// Compiles the pattern component [p, p + len). Returns 0, or -1 when out of memory.
+static int compile_matcher(Matcher *m, const char *p, size_t len) {
+    m->count = 0;
+    m->dot_ok = len > 0 && p[0] == '.';
+    for (size_t i = 0; i < len;) {
+        size_t class_len = p[i] == '[' ? class_length(p + i, len - i) : 0;
+        if (p[i] == '*') {
+            // Consecutive stars are one star
+            if (m->count == 0 || m->steps[m->count - 1].kind != STEP_STAR) {
+                if (!add_step(m, STEP_STAR)) return -1;
+            }
+            i++;
+        } else if (p[i] == '?') {
+            if (!add_step(m, STEP_ANY)) return -1;
+            i++;
+        } else if (class_len > 0) {
+            Step *s = add_step(m, STEP_CLASS);
+            if (!s) return -1;
+            memset(s->set, 0, sizeof(s->set));
+            size_t j = i + 1, end = i + class_len - 1;
+            bool negate = p[j] == '!' || p[j] == '^';
+            if (negate) j++;
+            while (j < end) {
+                unsigned char lo = (unsigned char)p[j], hi = lo;
+                if (j + 2 < end && p[j + 1] == '-') {
+                    hi = (unsigned char)p[j + 2];
+                    j += 3;
+                } else {
+                    j++;
+                }
+                for (unsigned c = lo; c <= hi; c++) s->set[c >> 3] |= (uint8_t)(1u << (c & 7));
+            }
+            if (negate) {
+                for (int b = 0; b < 32; b++) s->set[b] = (uint8_t)~s->set[b];
+            }
+            s->set['/' >> 3] &= (uint8_t)~(1u << ('/' & 7));
+            i += class_len;
+        } else {
+            size_t start = i;
+            while (i < len && p[i] != '*' && p[i] != '?' &&
+                   !(p[i] == '[' && class_length(p + i, len - i) > 0)) {
+                i++;
+            }
+            Step *s = add_step(m, STEP_LITERAL);
+            if (!s) return -1;
+            s->text = p + start;
+            s->len = i - start;
+        }
+    }
+    // A trailing literal after a star is checked first, as one memcmp
+    m->suffix = NULL;
+    m->suffix_len = 0;
+    if (m->count >= 2 && m->steps[m->count - 1].kind == STEP_LITERAL &&
+        m->steps[m->count - 2].kind == STEP_STAR) {
+        m->suffix = m->steps[m->count - 1].text;
+        m->suffix_len = m->steps[m->count - 1].len;
+    }
+    return 0;
+}
+
+// Wildcard matching that backtracks only to the most recent star, so it is
+// linear for the usual patterns
+static bool matcher_match(const Matcher *m, const char *s, size_t len) {
+    if (len > 0 && s[0] == '.' && !m->dot_ok) return false;
+    if (m->suffix && (len < m->suffix_len || memcmp(s + len - m->suffix_len, m->suffix, m->suffix_len) != 0)) {
+        return false;
+    }
+    int step = 0, star_step = -1;
+    size_t pos = 0, star_pos = 0;
+    while (step < m->count || pos < len) {
+        if (step < m->count) {
+            const Step *st = &m->steps[step];
+            switch (st->kind) {
+                case STEP_STAR:
+                    star_step = step++;
+                    star_pos = pos;
+                    continue;
+                case STEP_LITERAL:
+                    if (len - pos >= st->len && memcmp(s + pos, st->text, st->len) == 0) {
+                        pos += st->len;
+                        step++;
+                        continue;
+                    }
+                    break;
+                case STEP_ANY:
+                    if (pos < len) {
+                        pos++;
+                        step++;
+                        continue;
+                    }
+                    break;
+                case STEP_CLASS: {
+                    unsigned char c = pos < len ? (unsigned char)s[pos] : 0;
+                    if (pos < len && (st->set[c >> 3] & (1u << (c & 7)))) {
+                        pos++;
+                        step++;
+                        continue;
+                    }
+                    break;
+                }
+            }
+        }
+        // Let the last star take one more character and retry from there
+        if (star_step < 0 || star_pos >= len) return false;
+        pos = ++star_pos;
+        step = star_step + 1;
+    }
+    return true;
+}
+
+/* ----------------- Directory listings ----------------- */
+
+static void free_listings(void) {
+    for (int i = 0; i < listing_count; i++) {
+        free(listings[i].path);
+        free(listings[i].names);
+        free(listings[i].entries);
+        if (listings[i].dir_fd >= 0) close(listings[i].dir_fd);
+    }
+    listing_count = 0;
+}
+
+// Reads a directory with getdents64 into l, leaving it open in l->dir_fd.
+// Returns 0, or -1 when out of memory.
+static int read_listing(Listing *l, const char *path) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    l->dir_fd = -1;
+    if (fd < 0) {
+        l->error = errno;
+        return 0;
+    }
+    if (!dirent_buffer && !(dirent_buffer = malloc(DIRENT_BUFFER_SIZE))) {
+        close(fd);
+        return -1;
+    }
+    size_t names_cap = 0, entry_cap = 0;
+    while (1) {
+        long n = syscall(SYS_getdents64, fd, dirent_buffer, DIRENT_BUFFER_SIZE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (n < 0) l->error = errno;
+            break;
+        }
+        for (long off = 0; off < n;) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *)(dirent_buffer + off);
+            off += d->d_reclen;
+            const char *name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+            size_t len = strlen(name);
+            if (l->names_len + len + 1 > names_cap) {
+                size_t new_cap = names_cap ? names_cap * 2 : 4096;
+                while (new_cap < l->names_len + len + 1) new_cap *= 2;
+                char *p = realloc(l->names, new_cap);
+                if (!p) goto oom;
+                l->names = p;
+                names_cap = new_cap;
+            }
+            if (l->count >= entry_cap) {
+                size_t new_cap = entry_cap ? entry_cap * 2 : 256;
+                ListingEntry *p = realloc(l->entries, sizeof(ListingEntry) * new_cap);
+                if (!p) goto oom;
+                l->entries = p;
+                entry_cap = new_cap;
+            }
+            ListingEntry *e = &l->entries[l->count++];
+            e->name = (uint32_t)l->names_len;
+            e->len = (uint32_t)len;
+            e->type = d->d_type;
+            memcpy(l->names + l->names_len, name, len + 1);
+            l->names_len += len + 1;
+        }
+    }
+    l->dir_fd = fd;
+    return 0;
+oom:
+    close(fd);
+    return -1;
+}
+
+// The listing of path ("" for the current directory), read on first use in this line
+static Listing *get_listing(const char *path) {
+    for (int i = 0; i < listing_count; i++) {
+        if (strcmp(listings[i].path, path) == 0) return &listings[i];
+    }
+    if (listing_count >= listing_cap) {
+        int new_cap = listing_cap ? listing_cap * 2 : 8;
+        Listing *p = realloc(listings, sizeof(Listing) * new_cap);
+        if (!p) return NULL;
+        listings = p;
+        listing_cap = new_cap;
+    }
+    Listing *l = &listings[listing_count];
+    memset(l, 0, sizeof(*l));
+    l->path = strdup(path);
+    if (!l->path || read_listing(l, *path ? path : ".") != 0) {
+        free(l->path);
+        free(l->names);
+        free(l->entries);
+        return NULL;
+    }
+    listing_count++;
+    return l;
+}
+
+static bool entry_is_dir(const Listing *l, const ListingEntry *e) {
+    if (e->type == DT_DIR) return true;
+    if (e->type != DT_LNK && e->type != DT_UNKNOWN) return false;
+    // Only links and file systems without d_type cost a stat
+    struct stat st;
+    return fstatat(l->dir_fd, l->names + e->name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+}
+
+/* ----------------- Expansion ----------------- */
+
+static int add_result(Results *r, const char *prefix, size_t prefix_len, const char *name, size_t len) {
+    if (r->count >= r->cap) {
+        size_t new_cap = r->cap ? r->cap * 2 : 64;
+        char **p = realloc(r->items, sizeof(char*) * new_cap);
+        if (!p) return -1;
+        r->items = p;
+        r->cap = new_cap;
+    }
+    char *item = arena_alloc(&glob_arena, prefix_len + len + 1);
+    if (!item) return -1;
+    memcpy(item, prefix, prefix_len);
+    memcpy(item + prefix_len, name, len);
+    item[prefix_len + len] = '\0';
+    r->items[r->count++] = item;
+    return 0;
+}
+
+// Expands the components of rest below the directory prefix (as written,
+// ending in '/' unless empty). Returns 0, or -1 when out of memory.
+static int expand_below(Results *r, Matcher *m, char **prefix, size_t prefix_len, size_t *prefix_cap,
+                        const char *rest, bool globbed) {
+    const char *slash = strchr(rest, '/');
+    size_t comp_len = slash ? (size_t)(slash - rest) : strlen(rest);
+    // Grows the path buffer to hold prefix + a name + '/'
+    size_t need = prefix_len + comp_len + 2;
+
+    if (!is_pattern_n(rest, comp_len)) {
+        if (need > *prefix_cap) {
+            char *p = realloc(*prefix, need * 2);
+            if (!p) return -1;
+            *prefix = p;
+            *prefix_cap = need * 2;
+        }
+        memcpy(*prefix + prefix_len, rest, comp_len);
+        size_t len = prefix_len + comp_len;
+        if (slash) {
+            (*prefix)[len] = '/';
+            return expand_below(r, m, prefix, len + 1, prefix_cap, slash + 1, globbed);
+        }
+        (*prefix)[len] = '\0';
+        // A literal tail after a pattern must exist
+        struct stat st;
+        if (globbed && fstatat(AT_FDCWD, *prefix, &st, AT_SYMLINK_NOFOLLOW) != 0) return 0;
+        return add_result(r, *prefix, len, "", 0);
+    }
+
+    (*prefix)[prefix_len] = '\0';
+    Listing *l = get_listing(*prefix);
+    if (!l) return -1;
+    if (compile_matcher(m, rest, comp_len) != 0) return -1;
+    // The matcher is reused by deeper components, so matches are collected first
+    size_t first = r->count;
+    for (size_t i = 0; i < l->count; i++) {
+        const ListingEntry *e = &l->entries[i];
+        if (!matcher_match(m, l->names + e->name, e->len)) continue;
+        if (slash && !entry_is_dir(l, e)) continue;
+        if (add_result(r, *prefix, prefix_len, l->names + e->name, e->len) != 0) return -1;
+    }
+    if (!slash) return 0;
+    // Each matched directory continues with the rest of the pattern
+    size_t last = r->count;
+    char **dirs = malloc(sizeof(char*) * (last - first + 1));
+    if (!dirs) return -1;
+    memcpy(dirs, r->items + first, sizeof(char*) * (last - first));
+    r->count = first;
+    int status = 0;
+    for (size_t d = 0; d < last - first && status == 0; d++) {
+        size_t len = strlen(dirs[d]);
+        if (len + 2 > *prefix_cap) {
+            char *p = realloc(*prefix, (len + 2) * 2);
+            if (!p) {
+                status = -1;
+                break;
+            }
+            *prefix = p;
+            *prefix_cap = (len + 2) * 2;
+        }
+        memcpy(*prefix, dirs[d], len);
+        (*prefix)[len] = '/';
+        status = expand_below(r, m, prefix, len + 1, prefix_cap, slash + 1, true);
+    }
+    free(dirs);
+    return status;
+}
+
+static int compare_strings(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Appends the expansion of word (or word itself if nothing matches) to r
+static int expand_word(Results *r, Matcher *m, char **prefix, size_t *prefix_cap, char *word) {
+    size_t first = r->count;
+    const char *rest = word;
+    size_t prefix_len = 0;
+    if (*prefix_cap == 0) {
+        if (!(*prefix = malloc(256))) return -1;
+        *prefix_cap = 256;
+    }
+    if (*word == '/') {
+        // Absolute patterns start below the root
+        (*prefix)[0] = '/';
+        prefix_len = 1;
+        rest = word + 1;
+    }
+    if (expand_below(r, m, prefix, prefix_len, prefix_cap, rest, false) != 0) return -1;
+    if (r->count == first) {
+        if (add_result(r, "", 0, "", 0) != 0) return -1;
+        r->items[first] = word;
+        return 0;
+    }
+    qsort(r->items + first, r->count - first, sizeof(char*), compare_strings);
+    return 0;
+}
+
+int wildcard_expand(Command *cmds, int cmd_count) {
+    if (!wildcard_enabled()) return 0;
+    // The previous line's words are no longer needed; a huge expansion's memory is returned
+    if (glob_arena.total_cap > (1u << 20)) arena_free(&glob_arena);
+    else arena_reset(&glob_arena);
+
+    int patterns = 0;
+    Results r = { NULL, 0, 0 };
+    Matcher m = { NULL, 0, 0, false, NULL, 0 };
+    char *prefix = NULL;
+    size_t prefix_cap = 0;
+    int status = 0;
+    for (int c = 0; c < cmd_count && status == 0; c++) {
+        Command *cmd = &cmds[c];
+        int pattern_args = 0;
+        for (int a = 0; a < cmd->arg_count; a++) {
+            if (wildcard_is_pattern(cmd->args[a])) pattern_args++;
+        }
+        if (pattern_args == 0) continue;
+        patterns += pattern_args;
+        r.count = 0;
+        for (int a = 0; a < cmd->arg_count && status == 0; a++) {
+            if (!wildcard_is_pattern(cmd->args[a])) {
+                status = add_result(&r, "", 0, "", 0);
+                if (status == 0) r.items[r.count - 1] = cmd->args[a];
+            } else {
+                status = expand_word(&r, &m, &prefix, &prefix_cap, cmd->args[a]);
+            }
+        }
+        if (status != 0) break;
+        char **args = arena_alloc(&glob_arena, sizeof(char*) * (r.count + 1));
+        if (!args) {
+            status = -1;
+            break;
+        }
+        memcpy(args, r.items, sizeof(char*) * r.count);
+        args[r.count] = NULL;
+        cmd->args = args;
+        cmd->arg_count = (int)r.count;
+        cmd->name = args[0];
+    }
+    free(r.items);
+    free(m.steps);
+    free(prefix);
+    free_listings();
+    if (status != 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return patterns;
+}
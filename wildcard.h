@@ -0,0 +1,25 @@
+#ifndef WILDCARD_H
+#define WILDCARD_H
+
+#include <stdbool.h>
+#include "parallel.h"
+
+// Filename expansion. Words containing *, ? or [...] are replaced by the
+// sorted paths they match; a word that matches nothing is passed on as
+// written. As usual a leading '.' in a name must be matched explicitly, and a
+// pattern may span directories (logs/*/err-?.txt). Directories are read in
+// bulk with getdents64, using d_type rather than stat where the file system
+// provides it, and each listing is kept for the rest of the line, so several
+// patterns over one directory share a single scan. Disabled by WISH_GLOB=off.
+
+bool wildcard_enabled(void);
+
+// True if word contains a pattern character
+bool wildcard_is_pattern(const char *word);
+
+// Expands the arguments of cmds in place (their args vectors are replaced;
+// the new strings live until the next call). Returns the number of pattern
+// words, so 0 means nothing changed, or -1 if memory ran out.
+int wildcard_expand(Command *cmds, int cmd_count);
+
+#endif // WILDCARD_H
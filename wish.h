@@ -11,6 +11,7 @@ extern int shell_path_count;
 // Error handling
 void shell_error(int err_code);
 void print_errno(void);
+extern unsigned long shell_error_count; // errors reported so far
 
 // Input parsing
 int tokenize_input(char *input, char **tokens, int max_tokens);
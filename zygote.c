@@ -0,0 +1,401 @@
+#define _GNU_SOURCE // For pipe2 and MSG_CMSG_CLOEXEC
+#include "zygote.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "spawn.h"
+#include "affinity.h"
+#include "env.h"
+#include "wish.h"
+
+// Largest program + argv a request may carry; bigger commands are spawned by the
+// shell itself. SOCK_SEQPACKET messages must fit in the socket buffer.
+#define ZYGOTE_MAX_PAYLOAD (60 * 1024)
+
+// Shell -> zygote. Followed in the same message by the program path, the argv
+// strings and env_count environment entries, each NUL-terminated, and by the
+// descriptors named in fd_mask (bit 0 stdin, bit 1 stdout, bit 2 stderr, bit 3
+// the shell's working directory, sent after each cd).
+typedef struct {
+    int argc;
+    int fd_mask;
+    int cpu;       // chosen by the shell's affinity policy, -1 to inherit
+    int env_count; // -1 unless the shell's environment changed since the last request
+} SpawnRequest;
+
+enum { MSG_SPAWNED, MSG_EXITED };
+
+// Zygote -> shell. MSG_SPAWNED answers each request in order (pid, or error);
+// MSG_EXITED reports a child's wait status and usage whenever it exits.
+typedef struct {
+    int type;
+    pid_t pid;
+    int error;
+    int status;
+    struct rusage usage;
+} ZygoteMessage;
+
+static int sock = -1;          // shell's end of the socketpair
+static pid_t zygote_pid = 0;
+
+static unsigned long sent_env_generation = 0; // environment the zygote has
+static bool cwd_changed = false; // the zygote's working directory is stale
+
+static pid_t *owned = NULL;    // started by the zygote, exit not yet taken
+static int owned_count = 0;
+static int owned_cap = 0;
+
+static ZygoteMessage *exits = NULL; // exit reports waiting to be taken
+static int exit_count = 0;
+static int exit_cap = 0;
+
+/* ----------------- Zygote process ----------------- */
+
+static int sigchld_pipe[2] = { -1, -1 };
+
+static void sigchld_handler(int sig) {
+    (void)sig;
+    int saved = errno;
+    write(sigchld_pipe[1], "", 1);
+    errno = saved;
+}
+
+static void send_message(int fd, const ZygoteMessage *msg) {
+    while (send(fd, msg, sizeof(*msg), MSG_NOSIGNAL) < 0 && errno == EINTR) {}
+}
+
+static void report_exits(int fd) {
+    ZygoteMessage msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_EXITED;
+    while ((msg.pid = wait4(-1, &msg.status, WNOHANG, &msg.usage)) > 0) {
+        send_message(fd, &msg);
+    }
+}
+
+// Receives one request and starts it. Returns 0 once the shell has gone away.
+static int serve_request(int fd, char *buf) {
+    char control[CMSG_SPACE(sizeof(int) * 4)];
+    struct iovec iov = { buf, sizeof(SpawnRequest) + ZYGOTE_MAX_PAYLOAD };
+    struct msghdr hdr = { .msg_iov = &iov, .msg_iovlen = 1,
+                          .msg_control = control, .msg_controllen = sizeof(control) };
+    ssize_t n = recvmsg(fd, &hdr, MSG_CMSG_CLOEXEC);
+    if (n < 0) return errno == EINTR ? 1 : 0;
+    if (n == 0) return 0;
+
+    int fds[4] = { -1, -1, -1, -1 };
+    int received[4];
+    int received_count = 0;
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+    if (cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        received_count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        if (received_count > 4) received_count = 4;
+        memcpy(received, CMSG_DATA(cmsg), sizeof(int) * received_count);
+    }
+
+    ZygoteMessage reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.type = MSG_SPAWNED;
+    SpawnRequest req;
+    memcpy(&req, buf, sizeof(req));
+    int env_count = req.env_count > 0 ? req.env_count : 0;
+    char **argv = (size_t)n > sizeof(req) && req.argc > 0 ? malloc(sizeof(char*) * (req.argc + 1 + env_count)) : NULL;
+    if (!argv) {
+        reply.pid = -1;
+        reply.error = (size_t)n > sizeof(req) && req.argc > 0 ? ENOMEM : EINVAL;
+    } else {
+        buf[n] = '\0';
+        int next = 0;
+        for (int bit = 0; bit < 4; bit++) {
+            if ((req.fd_mask & (1 << bit)) && next < received_count) fds[bit] = received[next++];
+        }
+        char *p = buf + sizeof(req);
+        char *end = buf + n;
+        const char *program = p;
+        p += strlen(p) + 1;
+        for (int i = 0; i < req.argc; i++) {
+            argv[i] = p < end ? p : "";
+            p += strlen(argv[i]) + 1;
+        }
+        argv[req.argc] = NULL;
+        if (req.env_count >= 0) {
+            char **env = argv + req.argc + 1;
+            for (int i = 0; i < env_count; i++) {
+                env[i] = p < end ? p : "";
+                p += strlen(env[i]) + 1;
+            }
+            env_replace(env, env_count);
+        }
+        // Children start in the directory the shell has cd'd to
+        if (fds[3] >= 0 && fchdir(fds[3]) != 0) {
+            reply.pid = -1;
+        } else {
+            reply.pid = spawn_command_on(program, argv, NULL, fds[0], fds[1], fds[2], req.cpu);
+        }
+        reply.error = reply.pid < 0 ? errno : 0;
+        free(argv);
+    }
+    for (int i = 0; i < received_count; i++) close(received[i]);
+    send_message(fd, &reply);
+    return 1;
+}
+
+static void zygote_main(int fd) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = sigchld_handler;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigemptyset(&sa.sa_mask);
+    if (pipe2(sigchld_pipe, O_CLOEXEC | O_NONBLOCK) != 0 || sigaction(SIGCHLD, &sa, NULL) != 0) {
+        _exit(1);
+    }
+    char *buf = malloc(sizeof(SpawnRequest) + ZYGOTE_MAX_PAYLOAD + 1);
+    if (!buf) _exit(1);
+    while (1) {
+        struct pollfd pfds[2] = { { fd, POLLIN, 0 }, { sigchld_pipe[0], POLLIN, 0 } };
+        if (poll(pfds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            _exit(1);
+        }
+        if (pfds[1].revents) {
+            char drain[64];
+            while (read(sigchld_pipe[0], drain, sizeof(drain)) > 0) {}
+            report_exits(fd);
+        }
+        if (pfds[0].revents && serve_request(fd, buf) == 0) {
+            _exit(0); // the shell exited; its remaining children carry on
+        }
+    }
+}
+
+/* ----------------- Shell side ----------------- */
+
+void zygote_init_from_env(void) {
+    const char *env = getenv("WISH_ZYGOTE");
+    if (!env || strcmp(env, "on") != 0 || sock >= 0) return;
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, pair) != 0) {
+        print_errno(); // carry on without the zygote
+        return;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        print_errno();
+        close(pair[0]);
+        close(pair[1]);
+        return;
+    }
+    if (pid == 0) {
+        close(pair[0]);
+        zygote_main(pair[1]);
+    }
+    close(pair[1]);
+    sock = pair[0];
+    zygote_pid = pid;
+}
+
+void zygote_note_chdir(void) {
+    cwd_changed = true;
+}
+
+bool zygote_active(void) {
+    return sock >= 0;
+}
+
+int zygote_fd(void) {
+    return sock;
+}
+
+static int grow(void **items, int *cap, size_t item_size) {
+    int new_cap = *cap ? *cap * 2 : 16;
+    void *p = realloc(*items, item_size * new_cap);
+    if (!p) return -1;
+    *items = p;
+    *cap = new_cap;
+    return 0;
+}
+
+// The zygote is gone: nothing will report the children it started, so they are
+// reported as exited now rather than waited for forever
+static void zygote_lost(void) {
+    close(sock);
+    sock = -1;
+    waitpid(zygote_pid, NULL, 0);
+    for (int i = 0; i < owned_count; i++) {
+        if (exit_count >= exit_cap && grow((void **)&exits, &exit_cap, sizeof(ZygoteMessage)) != 0) break;
+        ZygoteMessage *msg = &exits[exit_count++];
+        memset(msg, 0, sizeof(*msg));
+        msg->type = MSG_EXITED;
+        msg->pid = owned[i];
+    }
+}
+
+// Keeps an exit report until the reaper takes it
+static void queue_exit(const ZygoteMessage *msg) {
+    if (exit_count >= exit_cap && grow((void **)&exits, &exit_cap, sizeof(ZygoteMessage)) != 0) return;
+    exits[exit_count++] = *msg;
+}
+
+void zygote_pump(void) {
+    while (sock >= 0) {
+        ZygoteMessage msg;
+        ssize_t n = recv(sock, &msg, sizeof(msg), MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n != (ssize_t)sizeof(msg)) {
+            zygote_lost();
+            return;
+        }
+        if (msg.type == MSG_EXITED) queue_exit(&msg);
+    }
+}
+
+pid_t zygote_spawn(const char *program, char *const argv[], const char *redir_target,
+                   int stdin_fd, int stdout_fd, int stderr_fd) {
+    if (sock < 0) {
+        errno = ENOTCONN;
+        return -1;
+    }
+    SpawnRequest req = { 0, 0, -1, -1 };
+    size_t payload = strlen(program) + 1;
+    for (; argv[req.argc]; req.argc++) payload += strlen(argv[req.argc]) + 1;
+    // After export or unset the request carries the whole environment once
+    unsigned long env_gen = env_generation();
+    char *const *envp = env_block();
+    if (env_gen != sent_env_generation) {
+        for (req.env_count = 0; envp[req.env_count]; req.env_count++) payload += strlen(envp[req.env_count]) + 1;
+    }
+    if (payload > ZYGOTE_MAX_PAYLOAD) {
+        errno = ENOTCONN;
+        return -1;
+    }
+    if (owned_count >= owned_cap && grow((void **)&owned, &owned_cap, sizeof(pid_t)) != 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    // The redirect is opened here, so failures are reported exactly as a local spawn's
+    int redir_fd = -1;
+    if (redir_target) {
+        redir_fd = open(redir_target, O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644);
+        if (redir_fd < 0) return -1;
+        stdout_fd = redir_fd;
+        stderr_fd = redir_fd;
+    }
+    // After a cd the request carries the new working directory once
+    int cwd_fd = -1;
+    if (cwd_changed) {
+        cwd_fd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (cwd_fd < 0) {
+            if (redir_fd >= 0) close(redir_fd);
+            return -1;
+        }
+    }
+    int fds[4] = { stdin_fd, stdout_fd, stderr_fd, cwd_fd };
+    int passed[4];
+    int passed_count = 0;
+    for (int bit = 0; bit < 4; bit++) {
+        if (fds[bit] >= 0) {
+            req.fd_mask |= 1 << bit;
+            passed[passed_count++] = fds[bit];
+        }
+    }
+
+    char *buf = malloc(payload);
+    if (!buf) {
+        if (redir_fd >= 0) close(redir_fd);
+        if (cwd_fd >= 0) close(cwd_fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    char *p = stpcpy(buf, program) + 1;
+    for (int i = 0; i < req.argc; i++) p = stpcpy(p, argv[i]) + 1;
+    for (int i = 0; i < req.env_count; i++) p = stpcpy(p, envp[i]) + 1; // none if -1
+
+    req.cpu = affinity_next_cpu();
+    struct iovec iov[2] = { { &req, sizeof(req) }, { buf, payload } };
+    char control[CMSG_SPACE(sizeof(int) * 4)];
+    memset(control, 0, sizeof(control));
+    struct msghdr hdr = { .msg_iov = iov, .msg_iovlen = 2 };
+    if (passed_count > 0) {
+        hdr.msg_control = control;
+        hdr.msg_controllen = CMSG_SPACE(sizeof(int) * passed_count);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * passed_count);
+        memcpy(CMSG_DATA(cmsg), passed, sizeof(int) * passed_count);
+    }
+    ssize_t sent;
+    while ((sent = sendmsg(sock, &hdr, MSG_NOSIGNAL)) < 0 && errno == EINTR) {}
+    free(buf);
+    if (redir_fd >= 0) close(redir_fd);
+    if (cwd_fd >= 0) close(cwd_fd);
+    if (sent < 0) {
+        zygote_lost();
+        errno = ENOTCONN;
+        return -1;
+    }
+    sent_env_generation = env_gen;
+    cwd_changed = false;
+
+    // Exit reports that arrive before the answer are queued for the reaper
+    while (1) {
+        ZygoteMessage msg;
+        ssize_t n = recv(sock, &msg, sizeof(msg), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n != (ssize_t)sizeof(msg)) {
+            zygote_lost();
+            errno = ENOTCONN;
+            return -1;
+        }
+        if (msg.type == MSG_EXITED) {
+            queue_exit(&msg);
+            continue;
+        }
+        if (msg.pid < 0) {
+            errno = msg.error;
+            return -1;
+        }
+        owned[owned_count++] = msg.pid;
+        return msg.pid;
+    }
+}
+
+bool zygote_owns(pid_t pid) {
+    for (int i = 0; i < owned_count; i++) {
+        if (owned[i] == pid) return true;
+    }
+    return false;
+}
+
+bool zygote_exit_reported(pid_t pid) {
+    for (int i = 0; i < exit_count; i++) {
+        if (exits[i].pid == pid) return true;
+    }
+    return false;
+}
+
+bool zygote_take_exit(pid_t pid, int *status, struct rusage *usage) {
+    for (int i = 0; i < exit_count; i++) {
+        if (exits[i].pid != pid) continue;
+        *status = exits[i].status;
+        *usage = exits[i].usage;
+        exits[i] = exits[--exit_count];
+        for (int j = 0; j < owned_count; j++) {
+            if (owned[j] == pid) {
+                owned[j] = owned[--owned_count];
+                break;
+            }
+        }
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,47 @@
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+// Optional launcher process. Forked at startup while the shell is still small,
+// it receives spawn requests over a Unix socketpair (program and argv in the
+// message, stdin/stdout/stderr descriptors through SCM_RIGHTS), starts the
+// child from its own small image and reports the pid and, later, the exit
+// status and rusage. Launch cost then stays flat however large the shell's
+// address space grows. Enabled with WISH_ZYGOTE=on.
+
+// Forks the zygote if WISH_ZYGOTE=on. Call early in main, before large allocations.
+void zygote_init_from_env(void);
+
+bool zygote_active(void);
+
+// Tells the zygote layer that the shell changed directory; the next request
+// passes the new one, so children start where the shell is
+void zygote_note_chdir(void);
+
+// Like spawn_command_fds, but the zygote starts the child, so the shell cannot
+// waitpid for it: its exit is reported through zygote_take_exit. Returns the
+// pid, or -1 with errno set (ENOTCONN if the zygote cannot take the request,
+// because it is too large or the zygote has gone, in which case the caller
+// should spawn the command itself).
+pid_t zygote_spawn(const char *program, char *const argv[], const char *redir_target,
+                   int stdin_fd, int stdout_fd, int stderr_fd);
+
+// True if pid was started by the zygote and has not been taken yet
+bool zygote_owns(pid_t pid);
+
+// Socket that becomes readable when the zygote reports something (or -1)
+int zygote_fd(void);
+
+// Reads whatever the zygote has sent without blocking
+void zygote_pump(void);
+
+// True if the exit of pid has been received and is waiting to be taken
+bool zygote_exit_reported(pid_t pid);
+
+// If the exit of pid has been reported, fills status/usage and returns true
+bool zygote_take_exit(pid_t pid, int *status, struct rusage *usage);
+
+#endif // ZYGOTE_H